@@ -0,0 +1,282 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "algebra.h"
+#include "squiggle_c/squiggle.h"
+#include "squiggle_c/squiggle_more.h"
+
+#define MAX_TERMS 64 // per flattened product or sum
+
+/* Constructors */
+static Node* node_new(Node_type type)
+{
+    Node* node = (Node*)calloc(1, sizeof(Node));
+    if (node == NULL) {
+        fprintf(stderr, "Memory allocation for node failed\n");
+        exit(1);
+    }
+    node->type = type;
+    return node;
+}
+
+static Node* node_leaf(Node_type type, double a, double b)
+{
+    Node* node = node_new(type);
+    node->a = a;
+    node->b = b;
+    return node;
+}
+
+Node* node_constant(double value) { return node_leaf(NODE_CONSTANT, value, 0); }
+Node* node_normal(double mean, double std) { return node_leaf(NODE_NORMAL, mean, std); }
+Node* node_lognormal(double logmean, double logstd) { return node_leaf(NODE_LOGNORMAL, logmean, logstd); }
+Node* node_beta(double a, double b) { return node_leaf(NODE_BETA, a, b); }
+
+Node* node_to(double low, double high)
+{
+    lognormal_params params = convert_ci_to_lognormal_params((ci) { .low = low, .high = high });
+    return node_lognormal(params.logmean, params.logstd);
+}
+
+Node* node_sampler(double (*sampler)(uint64_t* seed))
+{
+    Node* node = node_new(NODE_SAMPLER);
+    node->sampler = sampler;
+    return node;
+}
+
+static Node* node_operation(Node_type type, Node* left, Node* right)
+{
+    // Reusing a node would make two branches share a random variable,
+    // which breaks the independence assumptions in node_simplify
+    if (left->n_parents > 0 || right->n_parents > 0) {
+        fprintf(stderr, "Node used more than once in %s (%d); create a new node instead\n", __FILE__, __LINE__);
+        exit(1);
+    }
+    Node* node = node_new(type);
+    node->left = left;
+    node->right = right;
+    left->n_parents++;
+    right->n_parents++;
+    return node;
+}
+
+Node* node_product(Node* left, Node* right) { return node_operation(NODE_PRODUCT, left, right); }
+Node* node_quotient(Node* left, Node* right) { return node_operation(NODE_QUOTIENT, left, right); }
+Node* node_sum(Node* left, Node* right) { return node_operation(NODE_SUM, left, right); }
+Node* node_difference(Node* left, Node* right) { return node_operation(NODE_DIFFERENCE, left, right); }
+
+/* Simplification */
+// Flatten nested products/quotients (or sums/differences) into a list of terms with signs,
+// where the sign is +1 for factors in the numerator (or added terms) and -1 otherwise
+typedef struct _Terms {
+    Node* nodes[MAX_TERMS];
+    int signs[MAX_TERMS];
+    int n;
+} Terms;
+
+static void collect_terms(Node* node, int sign, Node_type same, Node_type inverse, Terms* terms)
+{
+    if (node->type == same) {
+        collect_terms(node->left, sign, same, inverse, terms);
+        collect_terms(node->right, sign, same, inverse, terms);
+    } else if (node->type == inverse) {
+        collect_terms(node->left, sign, same, inverse, terms);
+        collect_terms(node->right, -sign, same, inverse, terms);
+    } else {
+        if (terms->n >= MAX_TERMS) {
+            fprintf(stderr, "More than %d terms in a single product or sum in %s (%d)\n", MAX_TERMS, __FILE__, __LINE__);
+            exit(1);
+        }
+        terms->nodes[terms->n] = node_simplify(node);
+        terms->signs[terms->n] = sign;
+        terms->n++;
+    }
+}
+
+static Node* simplify_product(Node* node)
+{
+    Terms terms = { .n = 0 };
+    collect_terms(node, 1, NODE_PRODUCT, NODE_QUOTIENT, &terms);
+
+    double constant = 1.0;
+    int n_lognormals = 0;
+    lognormal_params lognormal = { .logmean = 0.0, .logstd = 0.0 };
+    Node* numerator = NULL;
+    Node* denominator = NULL;
+    Node* only_normal = NULL;
+    int n_others = 0;
+    for (int i = 0; i < terms.n; i++) {
+        Node* term = terms.nodes[i];
+        int sign = terms.signs[i];
+        if (term->type == NODE_CONSTANT) {
+            constant = sign > 0 ? constant * term->a : constant / term->a;
+            node_free(term);
+        } else if (term->type == NODE_LOGNORMAL) {
+            // 1/lognormal(m, s) = lognormal(-m, s)
+            lognormal = algebra_product_lognormals(lognormal, (lognormal_params) { .logmean = sign * term->a, .logstd = term->b });
+            n_lognormals++;
+            node_free(term);
+        } else if (sign > 0) {
+            numerator = numerator == NULL ? term : node_product(numerator, term);
+            if (term->type == NODE_NORMAL) only_normal = term;
+            n_others++;
+        } else {
+            denominator = denominator == NULL ? term : node_product(denominator, term);
+            n_others++;
+        }
+    }
+
+    // c * normal(m, s) = normal(c * m, |c| * s)
+    if (n_lognormals == 0 && n_others == 1 && only_normal != NULL) {
+        only_normal->a *= constant;
+        only_normal->b *= fabs(constant);
+        return only_normal;
+    }
+
+    Node* result = NULL;
+    if (n_lognormals > 0) {
+        result = node_lognormal(lognormal.logmean, lognormal.logstd);
+    }
+    if (numerator != NULL) {
+        result = result == NULL ? numerator : node_product(result, numerator);
+    }
+    if (denominator != NULL) {
+        result = node_quotient(result == NULL ? node_constant(1.0) : result, denominator);
+    }
+    if (result == NULL) {
+        result = node_constant(constant);
+    } else if (constant != 1.0) {
+        result = node_product(result, node_constant(constant));
+    }
+    return result;
+}
+
+static Node* simplify_sum(Node* node)
+{
+    Terms terms = { .n = 0 };
+    collect_terms(node, 1, NODE_SUM, NODE_DIFFERENCE, &terms);
+
+    double constant = 0.0;
+    int n_normals = 0;
+    normal_params normal = { .mean = 0.0, .std = 0.0 };
+    Node* result = NULL;
+    for (int i = 0; i < terms.n; i++) {
+        Node* term = terms.nodes[i];
+        int sign = terms.signs[i];
+        if (term->type == NODE_CONSTANT) {
+            constant += sign * term->a;
+            node_free(term);
+        } else if (term->type == NODE_NORMAL) {
+            // -normal(m, s) = normal(-m, s)
+            normal = algebra_sum_normals(normal, (normal_params) { .mean = sign * term->a, .std = term->b });
+            n_normals++;
+            node_free(term);
+        } else if (result == NULL && sign > 0) {
+            result = term;
+        } else {
+            if (result == NULL) result = node_constant(0.0);
+            result = sign > 0 ? node_sum(result, term) : node_difference(result, term);
+        }
+    }
+
+    if (n_normals > 0) {
+        Node* fused = node_normal(normal.mean + constant, normal.std);
+        return result == NULL ? fused : node_sum(fused, result);
+    } else if (result == NULL) {
+        return node_constant(constant);
+    } else if (constant != 0.0) {
+        return node_sum(result, node_constant(constant));
+    }
+    return result;
+}
+
+Node* node_simplify(Node* node)
+{
+    switch (node->type) {
+    case NODE_PRODUCT:
+    case NODE_QUOTIENT:
+        return simplify_product(node);
+    case NODE_SUM:
+    case NODE_DIFFERENCE:
+        return simplify_sum(node);
+    case NODE_SAMPLER: {
+        Node* copy = node_new(NODE_SAMPLER);
+        copy->sampler = node->sampler;
+        return copy;
+    }
+    default:
+        return node_leaf(node->type, node->a, node->b);
+    }
+}
+
+/* Sampling */
+double node_sample(Node* node, uint64_t* seed)
+{
+    switch (node->type) {
+    case NODE_CONSTANT:
+        return node->a;
+    case NODE_NORMAL:
+        return sample_normal(node->a, node->b, seed);
+    case NODE_LOGNORMAL:
+        return sample_lognormal(node->a, node->b, seed);
+    case NODE_BETA:
+        return sample_beta(node->a, node->b, seed);
+    case NODE_SAMPLER:
+        return node->sampler(seed);
+    case NODE_PRODUCT:
+        return node_sample(node->left, seed) * node_sample(node->right, seed);
+    case NODE_QUOTIENT:
+        return node_sample(node->left, seed) / node_sample(node->right, seed);
+    case NODE_SUM:
+        return node_sample(node->left, seed) + node_sample(node->right, seed);
+    case NODE_DIFFERENCE:
+        return node_sample(node->left, seed) - node_sample(node->right, seed);
+    }
+    return NAN;
+}
+
+/* Debugging */
+static void node_print_inner(Node* node)
+{
+    switch (node->type) {
+    case NODE_CONSTANT:
+        printf("%g", node->a);
+        break;
+    case NODE_NORMAL:
+        printf("normal(%g, %g)", node->a, node->b);
+        break;
+    case NODE_LOGNORMAL:
+        printf("lognormal(%g, %g)", node->a, node->b);
+        break;
+    case NODE_BETA:
+        printf("beta(%g, %g)", node->a, node->b);
+        break;
+    case NODE_SAMPLER:
+        printf("sampler(%p)", (void*)node->sampler);
+        break;
+    default: {
+        const char* operators[] = { [NODE_PRODUCT] = "*", [NODE_QUOTIENT] = "/", [NODE_SUM] = "+", [NODE_DIFFERENCE] = "-" };
+        printf("(");
+        node_print_inner(node->left);
+        printf(" %s ", operators[node->type]);
+        node_print_inner(node->right);
+        printf(")");
+    }
+    }
+}
+
+void node_print(Node* node)
+{
+    node_print_inner(node);
+    printf("\n");
+}
+
+void node_free(Node* node)
+{
+    if (node == NULL) return;
+    node_free(node->left);
+    node_free(node->right);
+    free(node);
+}
@@ -0,0 +1,57 @@
+#ifndef FINISTERRAE_ALGEBRA
+#define FINISTERRAE_ALGEBRA
+
+#include <stdint.h>
+
+/*
+A small expression tree for building models, so that we can do algebra on them before sampling:
+- products and quotients of independent lognormals become a single lognormal
+- sums and differences of independent normals become a single normal
+- constants are folded
+Each node is one independent random variable, so a node can only be used once (trees, not graphs).
+*/
+
+typedef enum _Node_type {
+    NODE_CONSTANT,
+    NODE_NORMAL,
+    NODE_LOGNORMAL,
+    NODE_BETA,
+    NODE_SAMPLER,
+    NODE_PRODUCT,
+    NODE_QUOTIENT,
+    NODE_SUM,
+    NODE_DIFFERENCE,
+} Node_type;
+
+typedef struct _Node {
+    Node_type type;
+    double a; // constant value, normal mean, lognormal logmean or beta a
+    double b; // normal std, lognormal logstd or beta b
+    double (*sampler)(uint64_t* seed); // opaque sampler, for anything we can't do algebra on
+    struct _Node* left;
+    struct _Node* right;
+    int n_parents;
+} Node;
+
+/* Leaves */
+Node* node_constant(double value);
+Node* node_normal(double mean, double std);
+Node* node_lognormal(double logmean, double logstd);
+Node* node_to(double low, double high); // lognormal with the given 90% confidence interval, like sample_to
+Node* node_beta(double a, double b);
+Node* node_sampler(double (*sampler)(uint64_t* seed));
+
+/* Operations */
+Node* node_product(Node* left, Node* right);
+Node* node_quotient(Node* left, Node* right);
+Node* node_sum(Node* left, Node* right);
+Node* node_difference(Node* left, Node* right);
+
+/* Fuse and fold. Returns a new tree; the original is left as is */
+Node* node_simplify(Node* node);
+
+double node_sample(Node* node, uint64_t* seed);
+void node_print(Node* node);
+void node_free(Node* node);
+
+#endif
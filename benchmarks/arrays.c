@@ -0,0 +1,94 @@
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../squiggle_c/squiggle.h"
+#include "../squiggle_c/squiggle_more.h"
+
+/* The array helpers against the serial loops they replaced, on 1 to 16 threads; results must be bit-identical across thread counts */
+
+#define N_ELEMENTS ((int64_t)100 * MILLION)
+
+static double serial_sum(double* xs, int64_t n)
+{
+    double sum = 0.0;
+    for (int64_t i = 0; i < n; i++) {
+        sum += xs[i];
+    }
+    return sum;
+}
+
+static double serial_std(double* xs, int64_t n)
+{
+    double mean = serial_sum(xs, n) / (double)n;
+    double std = 0.0;
+    for (int64_t i = 0; i < n; i++) {
+        std += (xs[i] - mean) * (xs[i] - mean);
+    }
+    return sqrt(std / (double)n);
+}
+
+static void serial_cumsum(double* xs, double* out, int64_t n)
+{
+    out[0] = xs[0];
+    for (int64_t i = 1; i < n; i++) {
+        out[i] = out[i - 1] + xs[i];
+    }
+}
+
+int main()
+{
+    double* xs = (double*)malloc((size_t)N_ELEMENTS * sizeof(double));
+    double* cumsum = (double*)malloc((size_t)N_ELEMENTS * sizeof(double));
+    uint64_t seed = 42;
+    for (int64_t i = 0; i < N_ELEMENTS; i++) {
+        xs[i] = sample_lognormal(0.0, 1.0, &seed);
+    }
+    memset(cumsum, 0, (size_t)N_ELEMENTS * sizeof(double)); // so that the first timing doesn't include page faults
+
+    double start = omp_get_wtime();
+    double reference_sum = serial_sum(xs, N_ELEMENTS);
+    double serial_sum_time = omp_get_wtime() - start;
+    start = omp_get_wtime();
+    double reference_std = serial_std(xs, N_ELEMENTS);
+    double serial_std_time = omp_get_wtime() - start;
+    start = omp_get_wtime();
+    serial_cumsum(xs, cumsum, N_ELEMENTS);
+    double serial_cumsum_time = omp_get_wtime() - start;
+    double reference_total = cumsum[N_ELEMENTS - 1];
+
+    printf("%d hardware threads; runs with more threads than that are oversubscribed\n", omp_get_num_procs());
+    printf("%ld elements; serial: sum %.3fs, std %.3fs, cumsum %.3fs\n", N_ELEMENTS, serial_sum_time, serial_std_time, serial_cumsum_time);
+    printf("  threads      sum  mean+std    cumsum   sum rel. diff   std rel. diff   identical to 1 thread\n");
+    double first_sum = 0.0, first_mean = 0.0, first_std = 0.0, first_total = 0.0;
+    for (int n_threads = 1; n_threads <= 16; n_threads *= 2) {
+        omp_set_num_threads(n_threads);
+        start = omp_get_wtime();
+        double sum = array_sum(xs, N_ELEMENTS);
+        double sum_time = omp_get_wtime() - start;
+        double mean, std;
+        start = omp_get_wtime();
+        array_mean_std(xs, N_ELEMENTS, &mean, &std);
+        double std_time = omp_get_wtime() - start;
+        start = omp_get_wtime();
+        array_cumsum(xs, cumsum, N_ELEMENTS);
+        double cumsum_time = omp_get_wtime() - start;
+        double total = cumsum[N_ELEMENTS - 1];
+        if (n_threads == 1) {
+            first_sum = sum;
+            first_mean = mean;
+            first_std = std;
+            first_total = total;
+        }
+        int identical = sum == first_sum && mean == first_mean && std == first_std && total == first_total;
+        printf("  %7d  %6.3fs  %7.3fs  %7.3fs  %14.2e  %14.2e   %s\n", n_threads, sum_time, std_time, cumsum_time,
+            fabs(sum - reference_sum) / reference_sum, fabs(std - reference_std) / reference_std, identical ? "yes" : "NO");
+    }
+    printf("  cumsum total vs serial: rel. diff %.2e\n", fabs(first_total - reference_total) / reference_total);
+
+    free(xs);
+    free(cumsum);
+    return 0;
+}
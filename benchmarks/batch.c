@@ -0,0 +1,48 @@
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../model.h"
+
+/* Scalar vs columnar (batch) version of the sentinel model, drawn the same way samples.c does */
+
+#define N_SAMPLES (10 * MILLION)
+
+int main()
+{
+    int n_threads = omp_get_max_threads();
+    int n_samples = N_SAMPLES;
+    double* xs = (double*)malloc((size_t)n_samples * sizeof(double));
+    seed_cache_box* cache_box = (seed_cache_box*)malloc(sizeof(seed_cache_box) * (size_t)n_threads);
+    for (int thread_id = 0; thread_id < n_threads; thread_id++) {
+        cache_box[thread_id].seed = UINT64_MAX / 2 + thread_id;
+    }
+
+    double start = omp_get_wtime();
+    #pragma omp parallel for
+    for (int j = 0; j < n_samples; j++) {
+        int thread_id = omp_get_thread_num();
+        xs[j] = sample_cost_effectiveness_sentinel_bps_per_million(&(cache_box[thread_id].seed));
+    }
+    double scalar_time = omp_get_wtime() - start;
+    double scalar_mean = array_mean(xs, n_samples);
+
+    start = omp_get_wtime();
+    #pragma omp parallel for
+    for (int j = 0; j < n_samples; j += SAMPLER_BATCH_SIZE) {
+        int thread_id = omp_get_thread_num();
+        int batch_size = (n_samples - j) < SAMPLER_BATCH_SIZE ? (n_samples - j) : SAMPLER_BATCH_SIZE;
+        sample_cost_effectiveness_sentinel_bps_per_million_batch(xs + j, batch_size, &(cache_box[thread_id].seed));
+    }
+    double batch_time = omp_get_wtime() - start;
+    double batch_mean = array_mean(xs, n_samples);
+
+    printf("%d samples, %d threads\n", n_samples, n_threads);
+    printf("  scalar: %8.3fs, %6.1f ns/sample, mean %lf\n", scalar_time, 1e9 * scalar_time / n_samples, scalar_mean);
+    printf("  batch:  %8.3fs, %6.1f ns/sample, mean %lf\n", batch_time, 1e9 * batch_time / n_samples, batch_mean);
+    printf("  speedup: %.2fx\n", scalar_time / batch_time);
+
+    free(cache_box);
+    free(xs);
+    return 0;
+}
@@ -0,0 +1,43 @@
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../model.h"
+
+/* Scalar sample_beta vs sample_beta_batch, on one thread, for the beta parameters in the sentinel model */
+
+#define N_SAMPLES (10 * MILLION)
+
+int main()
+{
+    double parameters[][2] = { { 2, 20 }, { 5, 10 }, { 1, 100 }, { 5, 1000 }, { 3, 100 }, { 2, 100 } };
+    double* xs = (double*)malloc((size_t)N_SAMPLES * sizeof(double));
+    printf("%d samples per distribution, one thread\n", N_SAMPLES);
+    printf("  parameters     scalar ns/sample  batch ns/sample   speedup   mean (scalar, batch, exact)\n");
+    for (int p = 0; p < (int)(sizeof(parameters) / sizeof(parameters[0])); p++) {
+        double a = parameters[p][0];
+        double b = parameters[p][1];
+        uint64_t seed = UINT64_MAX / 2 + p;
+
+        double start = omp_get_wtime();
+        for (int i = 0; i < N_SAMPLES; i++) {
+            xs[i] = sample_beta(a, b, &seed);
+        }
+        double scalar_time = omp_get_wtime() - start;
+        double scalar_mean = array_mean(xs, N_SAMPLES);
+
+        start = omp_get_wtime();
+        for (int i = 0; i < N_SAMPLES; i += SAMPLER_BATCH_SIZE) {
+            int batch_size = (N_SAMPLES - i) < SAMPLER_BATCH_SIZE ? (N_SAMPLES - i) : SAMPLER_BATCH_SIZE;
+            sample_beta_batch(a, b, xs + i, batch_size, &seed);
+        }
+        double batch_time = omp_get_wtime() - start;
+        double batch_mean = array_mean(xs, N_SAMPLES);
+
+        printf("  beta(%g, %g)%*s %10.1f %16.1f %12.2fx   %.6f, %.6f, %.6f\n", a, b, (int)(6 - floor(log10(a)) - floor(log10(b))), "",
+            1e9 * scalar_time / N_SAMPLES, 1e9 * batch_time / N_SAMPLES, scalar_time / batch_time, scalar_mean, batch_mean, a / (a + b));
+    }
+    free(xs);
+    return 0;
+}
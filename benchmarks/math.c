@@ -0,0 +1,120 @@
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../squiggle_c/squiggle.h"
+#include "../squiggle_c/squiggle_math.h"
+
+/* Accuracy of squiggle_math.h against long double references, and its throughput against libm, over the samplers' input ranges */
+
+#define N_POINTS (4 * 1000 * 1000)
+
+static double ulp(double x)
+{
+    x = fabs(x);
+    return x < 2.2250738585072014e-308 ? 4.9406564584124654e-324 : nextafter(x, INFINITY) - x;
+}
+
+typedef struct _Function {
+    const char* name;
+    double low, high; // of the first argument
+    double (*squiggle)(double x, double y);
+    double (*libm)(double x, double y);
+    long double (*reference)(long double x, long double y);
+    int absolute; // error in ulps of 1 rather than of the result, for sin and cos near their zeros
+} Function;
+
+static double f_squiggle_exp(double x, double y) { UNUSED(y); return squiggle_exp(x); }
+static double f_libm_exp(double x, double y) { UNUSED(y); return exp(x); }
+static long double f_reference_exp(long double x, long double y) { UNUSED(y); return expl(x); }
+static double f_squiggle_log(double x, double y) { UNUSED(y); return squiggle_log(x); }
+static double f_libm_log(double x, double y) { UNUSED(y); return log(x); }
+static long double f_reference_log(long double x, long double y) { UNUSED(y); return logl(x); }
+static double f_squiggle_sin(double x, double y) { UNUSED(y); return squiggle_sin_2pi(x); }
+static double f_libm_sin(double x, double y) { UNUSED(y); return sin(2 * M_PI * x); }
+static long double f_reference_sin(long double x, long double y) { UNUSED(y); return sinl(2 * 3.141592653589793238462643383279502884L * x); }
+static double f_squiggle_cos(double x, double y) { UNUSED(y); return squiggle_cos_2pi(x); }
+static double f_libm_cos(double x, double y) { UNUSED(y); return cos(2 * M_PI * x); }
+static long double f_reference_cos(long double x, long double y) { UNUSED(y); return cosl(2 * 3.141592653589793238462643383279502884L * x); }
+static double f_squiggle_pow(double x, double y) { return squiggle_pow_positive(x, y); }
+static double f_libm_pow(double x, double y) { return pow(x, y); }
+static long double f_reference_pow(long double x, long double y) { return powl(x, y); }
+
+/* The kernels' loops, cloned per instruction set with -DSQUIGGLE_MULTIVERSION as the batch samplers are */
+SQUIGGLE_DISPATCH
+static void run_squiggle(int f, double* xs, double* ys, double* out)
+{
+    switch (f) {
+    case 0: case 1:
+        #pragma omp simd
+        for (int i = 0; i < N_POINTS; i++) out[i] = squiggle_exp(xs[i]);
+        break;
+    case 2: case 3:
+        #pragma omp simd
+        for (int i = 0; i < N_POINTS; i++) out[i] = squiggle_log(xs[i]);
+        break;
+    case 4:
+        #pragma omp simd
+        for (int i = 0; i < N_POINTS; i++) out[i] = squiggle_sin_2pi(xs[i]);
+        break;
+    case 5:
+        #pragma omp simd
+        for (int i = 0; i < N_POINTS; i++) out[i] = squiggle_cos_2pi(xs[i]);
+        break;
+    default:
+        #pragma omp simd
+        for (int i = 0; i < N_POINTS; i++) out[i] = squiggle_pow_positive(xs[i], ys[i]);
+    }
+}
+
+int main()
+{
+    Function functions[] = {
+        { "exp, x in [-10, 10]", -10, 10, f_squiggle_exp, f_libm_exp, f_reference_exp, 0 },
+        { "exp, x in [-708, 709]", -708, 709, f_squiggle_exp, f_libm_exp, f_reference_exp, 0 },
+        { "log, x in (0, 1)", 0, 1, f_squiggle_log, f_libm_log, f_reference_log, 0 },
+        { "log, x in (0, 1e6)", 0, 1e6, f_squiggle_log, f_libm_log, f_reference_log, 0 },
+        { "sin(2 pi u), u in [0, 1)", 0, 1, f_squiggle_sin, f_libm_sin, f_reference_sin, 1 },
+        { "cos(2 pi u), u in [0, 1)", 0, 1, f_squiggle_cos, f_libm_cos, f_reference_cos, 1 },
+        { "pow(u, y), y in [1, 4]", 0, 1, f_squiggle_pow, f_libm_pow, f_reference_pow, 0 },
+    };
+    double* xs = (double*)malloc(N_POINTS * sizeof(double));
+    double* ys = (double*)malloc(N_POINTS * sizeof(double));
+    double* out = (double*)malloc(N_POINTS * sizeof(double));
+    for (int i = 0; i < N_POINTS; i++) out[i] = 0.0; // so that the first timing doesn't include page faults
+    uint64_t seed = 42;
+    printf("%d points per function; ulps of the long double reference, rounded to double\n", N_POINTS);
+    printf("  %-28s %12s %12s %14s %12s\n", "function", "max ulp", "libm max ulp", "squiggle ns", "libm ns");
+    for (int f = 0; f < (int)(sizeof(functions) / sizeof(functions[0])); f++) {
+        Function* function = &functions[f];
+        for (int i = 0; i < N_POINTS; i++) {
+            xs[i] = function->low + (function->high - function->low) * sample_unit_uniform(&seed);
+            if (xs[i] == 0.0) xs[i] = function->high * 1e-300;
+            ys[i] = 1.0 + 3.0 * sample_unit_uniform(&seed);
+        }
+        double max_error = 0.0, max_libm_error = 0.0;
+        for (int i = 0; i < N_POINTS; i++) {
+            long double reference = function->reference(xs[i], ys[i]);
+            double unit = function->absolute ? ulp(1.0) : ulp((double)reference);
+            double error = fabsl((long double)function->squiggle(xs[i], ys[i]) - reference) / unit;
+            double libm_error = fabsl((long double)function->libm(xs[i], ys[i]) - reference) / unit;
+            if (error > max_error) max_error = error;
+            if (libm_error > max_libm_error) max_libm_error = libm_error;
+        }
+        // Throughput: each in its own loop, as in the batch samplers
+        double start = omp_get_wtime();
+        run_squiggle(f, xs, ys, out);
+        double squiggle_time = omp_get_wtime() - start;
+        double checksum = out[N_POINTS / 2];
+        start = omp_get_wtime();
+        for (int i = 0; i < N_POINTS; i++) out[i] = function->libm(xs[i], ys[i]);
+        double libm_time = omp_get_wtime() - start;
+        checksum += out[N_POINTS / 2];
+        printf("  %-28s %12.3f %12.3f %14.2f %12.2f%s\n", function->name, max_error, max_libm_error, 1e9 * squiggle_time / N_POINTS, 1e9 * libm_time / N_POINTS, checksum == checksum ? "" : " (NaN)");
+    }
+    free(xs);
+    free(ys);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,119 @@
+#!/bin/bash
+# Strong and weak scaling of sampler_finisterrae on one machine: over OpenMP threads with the NO_MPI build,
+# and over MPI ranks (one thread each) with local mpirun. Run from the repository root, e.g., with make bench-scaling.
+#
+# Strong scaling: STRONG_SAMPLES in total, however many threads or ranks draw them. Efficiency = T(1) / (workers * T(workers))
+# Weak scaling: WEAK_SAMPLES per thread or rank. Efficiency = T(1) / T(workers)
+# Each run is a single iteration of samples.c, and its times come from its "Time per phase" report.
+# Runs with more workers than cores are oversubscribed, so their efficiency says more about overhead than about speed.
+#
+# Environment:
+#   MAX_THREADS     (default: nproc)
+#   MAX_RANKS       (default: nproc)
+#   STRONG_SAMPLES  (default: 8000000)
+#   WEAK_SAMPLES    (default: 2000000)
+#   MPIRUN          (default: mpirun --oversubscribe; add --allow-run-as-root if needed). Set to "" to skip the MPI runs
+#   CFLAGS, SOURCES (set by the makefile)
+
+set -e
+
+MAX_THREADS=${MAX_THREADS:-$(nproc)}
+MAX_RANKS=${MAX_RANKS:-$(nproc)}
+STRONG_SAMPLES=${STRONG_SAMPLES:-8000000}
+WEAK_SAMPLES=${WEAK_SAMPLES:-2000000}
+MPIRUN=${MPIRUN-mpirun --oversubscribe}
+CFLAGS=${CFLAGS:--O3}
+SOURCES=${SOURCES:-samples.c model.c sensitivity.c algebra.c histogram.c exact_sum.c tail.c variance_reduction.c convergence.c reporter.c service.c result_cache.c work_pool.c shard.c ./squiggle_c/squiggle.c ./squiggle_c/squiggle_more.c}
+BUILD_DIR=./benchmarks/scaling-build
+REPORT=./benchmarks/scaling-report.txt
+
+rm -rf $BUILD_DIR
+mkdir -p $BUILD_DIR
+trap "rm -rf $BUILD_DIR" EXIT
+
+# build <gcc|mpicc> <samples per process>: one binary per compiler and chunk size, as both are compile time constants.
+# N_SAMPLES_TOTAL=0 makes samples.c stop after its first iteration.
+# It is called in a command substitution, where set -e doesn't stop the script, so callers check its status with || exit 1
+build() {
+    local binary=$BUILD_DIR/samples-$1-$2
+    if [ ! -x $binary ]; then
+        local flags="-DN_SAMPLES_PER_PROCESS=$2 -DN_SAMPLES_TOTAL=0"
+        if [ $1 = gcc ]; then flags="$flags -DNO_MPI"; fi
+        $1 $CFLAGS $flags $SOURCES -lm -fopenmp -o $binary >&2 || return 1
+    fi
+    echo $binary
+}
+
+# run <mode> <ranks> <threads> <command...>: one row of the report
+T1_SAMPLING=
+T1_TOTAL=
+run() {
+    local mode=$1 ranks=$2 threads=$3
+    shift 3
+    local output
+    output=$(OMP_NUM_THREADS=$threads "$@")
+    local times
+    times=$(echo "$output" | awk '
+        /^Time per phase/ { in_times = 1 }
+        in_times && /Setup:/ { setup = $2 }
+        in_times && /Sampling:/ { sampling = $2 }
+        in_times && /Statistics:/ { statistics = $2 }
+        in_times && /Gather:/ { gather = $2 }
+        in_times && /Total:/ { total = $2 }
+        in_times && /Samples:/ { samples = $2; rate = $3 }
+        END { gsub(/[s,]/, "", setup); gsub(/s/, "", sampling); gsub(/s/, "", statistics); gsub(/s/, "", gather); gsub(/s/, "", total); gsub(/,/, "", samples); print setup, sampling, statistics, gather, total, samples, rate }')
+    read setup sampling statistics gather total samples rate <<< "$times"
+    local workers=$((ranks * threads))
+    if [ $workers -eq 1 ]; then
+        T1_SAMPLING=$sampling
+        T1_TOTAL=$total
+    fi
+    awk -v mode=$mode -v ranks=$ranks -v threads=$threads -v workers=$workers \
+        -v setup=$setup -v sampling=$sampling -v statistics=$statistics -v gather=$gather -v total=$total -v samples=$samples -v rate=$rate \
+        -v t1_sampling=$T1_SAMPLING -v t1_total=$T1_TOTAL 'BEGIN {
+        strong = mode ~ /^strong/
+        sampling_efficiency = strong ? t1_sampling / (workers * sampling) : t1_sampling / sampling
+        total_efficiency = strong ? t1_total / (workers * total) : t1_total / total
+        printf("%-14s %5d %7d %11d %8.3f %9.3f %10.3f %8.3f %8.3f %12.4e %9.1f%% %9.1f%%\n",
+            mode, ranks, threads, samples, setup, sampling, statistics, gather, total, rate, 100 * sampling_efficiency, 100 * total_efficiency)
+    }' | tee -a $REPORT
+}
+
+{
+    echo "Scaling on $(hostname), $(nproc) cores, $(date)"
+    echo "Strong scaling: $STRONG_SAMPLES samples in total. Weak scaling: $WEAK_SAMPLES samples per worker"
+    echo "Times in seconds, max over processes. Efficiency of the sampling phase, and of the whole run"
+    printf "%-14s %5s %7s %11s %8s %9s %10s %8s %8s %12s %10s %10s\n" \
+        mode ranks threads samples setup sampling statistics gather total samples/s "eff(samp)" "eff(total)"
+} > $REPORT
+cat $REPORT
+
+threads=1
+while [ $threads -le $MAX_THREADS ]; do
+    binary=$(build gcc $STRONG_SAMPLES) || exit 1
+    run strong-threads 1 $threads $binary
+    threads=$((threads * 2))
+done
+threads=1
+while [ $threads -le $MAX_THREADS ]; do
+    binary=$(build gcc $((WEAK_SAMPLES * threads))) || exit 1
+    run weak-threads 1 $threads $binary
+    threads=$((threads * 2))
+done
+
+if [ -n "$MPIRUN" ]; then
+    ranks=1
+    while [ $ranks -le $MAX_RANKS ]; do
+        binary=$(build mpicc $((STRONG_SAMPLES / ranks))) || exit 1
+        run strong-ranks $ranks 1 $MPIRUN -np $ranks $binary
+        ranks=$((ranks * 2))
+    done
+    ranks=1
+    while [ $ranks -le $MAX_RANKS ]; do
+        binary=$(build mpicc $WEAK_SAMPLES) || exit 1
+        run weak-ranks $ranks 1 $MPIRUN -np $ranks $binary
+        ranks=$((ranks * 2))
+    done
+fi
+
+echo "Saved to $REPORT"
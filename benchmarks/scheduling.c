@@ -0,0 +1,107 @@
+#include <float.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../model.h"
+#include "../work_pool.h"
+
+/* OpenMP parallel for, as in samples.c, vs the work stealing pool, on 1 to 64 threads */
+
+#define N_SAMPLES (2 * MILLION)
+#define CHUNK_SIZE 16384
+
+// Uneven cost per sample: shape < 1 goes through sample_gamma's recursion, and rejections vary from draw to draw
+static double sample_uneven_gamma(uint64_t* seed)
+{
+    return sample_gamma(0.3, seed) + sample_gamma(2.5, seed);
+}
+
+typedef struct _Benchmark_task {
+    double (*sampler)(uint64_t* seed);
+    double* xs;
+    double* chunk_sums;
+} Benchmark_task;
+
+static void sample_chunk(int64_t begin, int64_t end, int64_t chunk, void* context)
+{
+    Benchmark_task* task = (Benchmark_task*)context;
+    uint64_t seed = UINT64_MAX / 2 + (uint64_t)chunk;
+    double sum = 0.0;
+    for (int64_t j = begin; j < end; j++) {
+        task->xs[j] = task->sampler(&seed);
+        sum += task->xs[j];
+    }
+    task->chunk_sums[chunk] = sum;
+}
+
+static double time_openmp(double (*sampler)(uint64_t*), double* xs, int n_threads, double* mean)
+{
+    // Two phases, each its own fork and join: sampling, then the reduction
+    seed_cache_box* cache_box = (seed_cache_box*)malloc(sizeof(seed_cache_box) * (size_t)n_threads);
+    for (int thread_id = 0; thread_id < n_threads; thread_id++) {
+        cache_box[thread_id].seed = UINT64_MAX / 2 + thread_id;
+    }
+    omp_set_num_threads(n_threads);
+    double start = omp_get_wtime();
+    #pragma omp parallel for
+    for (int64_t j = 0; j < N_SAMPLES; j++) {
+        xs[j] = sampler(&(cache_box[omp_get_thread_num()].seed));
+    }
+    double sum = 0.0;
+    #pragma omp parallel for reduction(+ : sum)
+    for (int64_t j = 0; j < N_SAMPLES; j++) {
+        sum += xs[j];
+    }
+    double time = omp_get_wtime() - start;
+    *mean = sum / N_SAMPLES;
+    free(cache_box);
+    return time;
+}
+
+static double time_work_stealing(double (*sampler)(uint64_t*), double* xs, int n_threads, double* mean)
+{
+    // One phase: sampling and partial sums per chunk. The pool is created outside the timing, as samples.c keeps it across iterations
+    int64_t n_chunks = (N_SAMPLES + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    Benchmark_task task = { .sampler = sampler, .xs = xs, .chunk_sums = (double*)malloc((size_t)n_chunks * sizeof(double)) };
+    Work_pool* pool = work_pool_create(n_threads);
+    if (pool == NULL) {
+        fprintf(stderr, "Starting %d work stealing threads failed.\n", n_threads);
+        exit(1);
+    }
+    double start = omp_get_wtime();
+    work_pool_run(pool, N_SAMPLES, CHUNK_SIZE, sample_chunk, &task);
+    double sum = 0.0;
+    for (int64_t chunk = 0; chunk < n_chunks; chunk++) {
+        sum += task.chunk_sums[chunk];
+    }
+    double time = omp_get_wtime() - start;
+    *mean = sum / N_SAMPLES;
+    work_pool_destroy(pool);
+    free(task.chunk_sums);
+    return time;
+}
+
+int main()
+{
+    double* xs = (double*)malloc((size_t)N_SAMPLES * sizeof(double));
+    struct {
+        const char* name;
+        double (*sampler)(uint64_t*);
+    } workloads[] = {
+        { "sentinel", sample_cost_effectiveness_sentinel_bps_per_million },
+        { "uneven gamma", sample_uneven_gamma },
+    };
+    printf("%d samples per run, %d hardware threads; runs with more threads than that are oversubscribed\n", N_SAMPLES, omp_get_num_procs());
+    for (int w = 0; w < 2; w++) {
+        printf("%s:\n  threads      openmp   work stealing   speedup\n", workloads[w].name);
+        for (int n_threads = 1; n_threads <= 64; n_threads *= 2) {
+            double openmp_mean, work_stealing_mean;
+            double openmp_time = time_openmp(workloads[w].sampler, xs, n_threads, &openmp_mean);
+            double work_stealing_time = time_work_stealing(workloads[w].sampler, xs, n_threads, &work_stealing_mean);
+            printf("  %7d  %9.3fs  %13.3fs  %7.2fx   (means %lf, %lf)\n", n_threads, openmp_time, work_stealing_time, openmp_time / work_stealing_time, openmp_mean, work_stealing_mean);
+        }
+    }
+    free(xs);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../model.h"
+
+/* A parameter sweep's access pattern: many medium batches, drawn with a fresh sampler_parallel each, or with one sampler_ctx */
+
+#define N_BATCHES 5000
+#define BATCH_SIZE 1000
+
+int main()
+{
+    int n_threads = omp_get_max_threads();
+    double* xs = (double*)malloc((size_t)BATCH_SIZE * sizeof(double));
+
+    double sum = 0.0;
+    double start = omp_get_wtime();
+    for (int b = 0; b < N_BATCHES; b++) {
+        sampler_parallel(sample_cost_effectiveness_sentinel_bps_per_million, xs, n_threads, BATCH_SIZE, b + 1);
+        sum += array_sum(xs, BATCH_SIZE);
+    }
+    double one_off_time = omp_get_wtime() - start;
+    double one_off_mean = sum / ((double)N_BATCHES * BATCH_SIZE);
+
+    sum = 0.0;
+    start = omp_get_wtime();
+    sampler_ctx* ctx = sampler_ctx_create(n_threads, 1);
+    if (ctx == NULL) {
+        fprintf(stderr, "Creating a sampler_ctx failed.\n");
+        return 1;
+    }
+    for (int b = 0; b < N_BATCHES; b++) {
+        sampler_parallel_ctx(ctx, sample_cost_effectiveness_sentinel_bps_per_million, xs, BATCH_SIZE);
+        sum += array_sum(xs, BATCH_SIZE);
+    }
+    sampler_ctx_free(ctx);
+    double ctx_time = omp_get_wtime() - start;
+    double ctx_mean = sum / ((double)N_BATCHES * BATCH_SIZE);
+
+    sum = 0.0;
+    start = omp_get_wtime();
+    ctx = sampler_ctx_create(n_threads, 1);
+    if (ctx == NULL) {
+        fprintf(stderr, "Creating a sampler_ctx failed.\n");
+        return 1;
+    }
+    for (int b = 0; b < N_BATCHES; b++) {
+        sampler_parallel_batch_ctx(ctx, sample_cost_effectiveness_sentinel_bps_per_million_batch, xs, BATCH_SIZE);
+        sum += array_sum(xs, BATCH_SIZE);
+    }
+    sampler_ctx_free(ctx);
+    double batch_ctx_time = omp_get_wtime() - start;
+    double batch_ctx_mean = sum / ((double)N_BATCHES * BATCH_SIZE);
+
+    printf("%d batches of %d samples, %d threads\n", N_BATCHES, BATCH_SIZE, n_threads);
+    printf("  sampler_parallel:           %8.3fs, %6.1f ns/sample, mean %lf\n", one_off_time, 1e9 * one_off_time / ((double)N_BATCHES * BATCH_SIZE), one_off_mean);
+    printf("  sampler_parallel_ctx:       %8.3fs, %6.1f ns/sample, mean %lf\n", ctx_time, 1e9 * ctx_time / ((double)N_BATCHES * BATCH_SIZE), ctx_mean);
+    printf("  sampler_parallel_batch_ctx: %8.3fs, %6.1f ns/sample, mean %lf\n", batch_ctx_time, 1e9 * batch_ctx_time / ((double)N_BATCHES * BATCH_SIZE), batch_ctx_mean);
+    printf("  speedup of the ctx: %.2fx, and of the batch ctx: %.2fx\n", one_off_time / ctx_time, one_off_time / batch_ctx_time);
+
+    free(xs);
+    return 0;
+}
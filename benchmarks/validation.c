@@ -0,0 +1,541 @@
+#include <float.h>
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../model.h"
+
+/*
+Goodness of fit of every sampler and of its fast variants, next to their throughput, so that speed-ups are accepted or rejected on evidence.
+For each distribution with a known CDF, each variant draws N_SAMPLES samples on all threads, and gets:
+- Kolmogorov-Smirnov and Anderson-Darling tests against the exact CDF. Both are distribution free; Anderson-Darling weighs the tails more.
+- Checks of the sample mean and variance against the exact ones, in standard errors from the exact variance and fourth central moment.
+  Standard errors estimated from the samples are far too small under heavy tails, which is how squiggle.c's tests came to report a
+  lognormal's std off by a factor of 463 (paper/index.md). Tolerances are from Chebyshev's inequality, which holds whenever the variance
+  is finite, rather than from the normal approximation, which heavy tails reach very slowly. Where they are wider than the moment itself,
+  the check can't tell much, and the samples it would take to get to MOMENT_RESOLUTION are reported instead.
+The fused and batch versions of the sentinel model have no known CDF, so they are checked against the scalar model, with two sample tests.
+Build with -DSQUIGGLE_LIBM to check the samplers with libm's functions instead of squiggle_math.h's (make bench-validation runs both).
+*/
+
+#ifndef N_SAMPLES
+#define N_SAMPLES (10 * MILLION)
+#endif
+#define CHUNK_SIZE 65536 // of samples seeded by their index, so that samples don't depend on the number of threads
+#define ALPHA 1e-3 // false rejection rate of each test
+#define MOMENT_RESOLUTION 0.1 // relative tolerance at which a moment check starts being informative
+#define NORMAL90CONFIDENCE 1.6448536269514727
+
+typedef enum _Family {
+    UNIT_UNIFORM,
+    UNIT_NORMAL,
+    NORMAL,
+    LOGNORMAL,
+    TO,
+    GAMMA,
+    BETA,
+    MODEL, // the sentinel model; no exact CDF
+} Family;
+
+typedef struct _Distribution {
+    Family family;
+    double a;
+    double b;
+    double log_normalization; // log gamma(a) for gammas, log B(a, b) for betas
+} Distribution;
+
+typedef void (*Fill)(const Distribution* distribution, double* out, int n, uint64_t* seed);
+
+typedef struct _Variant {
+    const char* name;
+    Fill fill;
+} Variant;
+
+/* Samplers, n <= SAMPLER_BATCH_SIZE at a time */
+static void fill_scalar(const Distribution* d, double* out, int n, uint64_t* seed)
+{
+    for (int i = 0; i < n; i++) {
+        switch (d->family) {
+        case UNIT_UNIFORM: out[i] = sample_unit_uniform(seed); break;
+        case UNIT_NORMAL: out[i] = sample_unit_normal(seed); break;
+        case NORMAL: out[i] = sample_normal(d->a, d->b, seed); break;
+        case LOGNORMAL: out[i] = sample_lognormal(d->a, d->b, seed); break;
+        case TO: out[i] = sample_to(d->a, d->b, seed); break;
+        case GAMMA: out[i] = sample_gamma(d->a, seed); break;
+        case BETA: out[i] = sample_beta(d->a, d->b, seed); break;
+        case MODEL: out[i] = sample_cost_effectiveness_sentinel_bps_per_million(seed); break;
+        }
+    }
+}
+
+static void fill_batch(const Distribution* d, double* out, int n, uint64_t* seed)
+{
+    switch (d->family) {
+    case UNIT_NORMAL: sample_unit_normal_batch(out, n, seed); break;
+    case NORMAL: sample_normal_batch(d->a, d->b, out, n, seed); break;
+    case LOGNORMAL: sample_lognormal_batch(d->a, d->b, out, n, seed); break;
+    case TO: sample_to_batch(d->a, d->b, out, n, seed); break;
+    case GAMMA: sample_gamma_batch(d->a, out, n, seed); break;
+    case BETA: sample_beta_batch(d->a, d->b, out, n, seed); break;
+    case MODEL: sample_cost_effectiveness_sentinel_bps_per_million_batch(out, n, seed); break;
+    default: fill_scalar(d, out, n, seed);
+    }
+}
+
+static void fill_fused_model(const Distribution* d, double* out, int n, uint64_t* seed)
+{
+    (void)d;
+    for (int i = 0; i < n; i++) {
+        out[i] = sample_cost_effectiveness_sentinel_bps_per_million_fused(seed);
+    }
+}
+
+// Returns the wall time taken
+static double draw(const Variant* variant, const Distribution* distribution, double* xs, int64_t n, uint64_t stream)
+{
+    int64_t n_chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    double start = omp_get_wtime();
+    #pragma omp parallel for schedule(dynamic)
+    for (int64_t c = 0; c < n_chunks; c++) {
+        uint64_t seed = mix_seed(stream * 0x100000000ULL + (uint64_t)c) | 1; // xorshift64 needs a nonzero seed
+        int64_t end = (c + 1) * CHUNK_SIZE < n ? (c + 1) * CHUNK_SIZE : n;
+        for (int64_t j = c * CHUNK_SIZE; j < end; j += SAMPLER_BATCH_SIZE) {
+            int batch_size = (end - j) < SAMPLER_BATCH_SIZE ? (int)(end - j) : SAMPLER_BATCH_SIZE;
+            variant->fill(distribution, xs + j, batch_size, &seed);
+        }
+    }
+    return omp_get_wtime() - start;
+}
+
+/* Sorting: each thread sorts a slice, then slices are merged pairwise */
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void parallel_sort(double* xs, double* scratch, int64_t n)
+{
+    int n_slices = 1;
+    while (n_slices < omp_get_max_threads()) {
+        n_slices *= 2;
+    }
+    int64_t* bounds = (int64_t*)malloc((size_t)(n_slices + 1) * sizeof(int64_t));
+    for (int s = 0; s <= n_slices; s++) {
+        bounds[s] = n * s / n_slices;
+    }
+    #pragma omp parallel for
+    for (int s = 0; s < n_slices; s++) {
+        qsort(xs + bounds[s], (size_t)(bounds[s + 1] - bounds[s]), sizeof(double), compare_doubles);
+    }
+    double* from = xs;
+    double* to = scratch;
+    for (int width = 1; width < n_slices; width *= 2) {
+        #pragma omp parallel for
+        for (int s = 0; s < n_slices; s += 2 * width) {
+            int64_t i = bounds[s], middle = bounds[s + width], j = middle, end = bounds[s + 2 * width], k = bounds[s];
+            while (i < middle && j < end) {
+                to[k++] = from[i] <= from[j] ? from[i++] : from[j++];
+            }
+            while (i < middle) to[k++] = from[i++];
+            while (j < end) to[k++] = from[j++];
+        }
+        double* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != xs) memcpy(xs, from, (size_t)n * sizeof(double));
+    free(bounds);
+}
+
+/* Exact CDFs, and survival functions 1 - CDF, computed directly so that they keep their precision in the right tail */
+static void incomplete_gamma(double a, double log_gamma_a, double x, double* p, double* q)
+{
+    // Regularized P(a, x) and Q(a, x): a series for x < a + 1, a continued fraction (modified Lentz) for Q otherwise.
+    // Press et al., "Numerical Recipes", 3rd ed., ch. 6.2
+    if (x <= 0) {
+        *p = 0.0;
+        *q = 1.0;
+        return;
+    }
+    double front = exp(-x + a * log(x) - log_gamma_a);
+    if (x < a + 1) {
+        double term = 1.0 / a, sum = term;
+        for (int k = 1; k < 10000 && fabs(term) > fabs(sum) * 1e-17; k++) {
+            term *= x / (a + k);
+            sum += term;
+        }
+        *p = front * sum;
+        *q = 1.0 - *p;
+        return;
+    }
+    double b = x + 1 - a, c = 1.0 / DBL_MIN, d = 1.0 / b, h = d;
+    for (int i = 1; i < 10000; i++) {
+        double an = -i * (i - a);
+        b += 2;
+        d = an * d + b;
+        if (fabs(d) < DBL_MIN) d = DBL_MIN;
+        c = b + an / c;
+        if (fabs(c) < DBL_MIN) c = DBL_MIN;
+        d = 1.0 / d;
+        h *= d * c;
+        if (fabs(d * c - 1.0) < 1e-16) break;
+    }
+    *q = front * h;
+    *p = 1.0 - *q;
+}
+
+static double beta_continued_fraction(double a, double b, double x)
+{
+    // Numerical Recipes, 3rd ed., ch. 6.4
+    double c = 1.0, d = 1.0 - (a + b) * x / (a + 1);
+    if (fabs(d) < DBL_MIN) d = DBL_MIN;
+    d = 1.0 / d;
+    double h = d;
+    for (int m = 1; m < 10000; m++) {
+        double aa = m * (b - m) * x / ((a - 1 + 2 * m) * (a + 2 * m));
+        d = 1.0 + aa * d;
+        if (fabs(d) < DBL_MIN) d = DBL_MIN;
+        c = 1.0 + aa / c;
+        if (fabs(c) < DBL_MIN) c = DBL_MIN;
+        d = 1.0 / d;
+        h *= d * c;
+        aa = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 1 + 2 * m));
+        d = 1.0 + aa * d;
+        if (fabs(d) < DBL_MIN) d = DBL_MIN;
+        c = 1.0 + aa / c;
+        if (fabs(c) < DBL_MIN) c = DBL_MIN;
+        d = 1.0 / d;
+        h *= d * c;
+        if (fabs(d * c - 1.0) < 1e-16) break;
+    }
+    return h;
+}
+
+static void incomplete_beta(double a, double b, double log_beta, double x, double* p, double* q)
+{
+    if (x <= 0 || x >= 1) {
+        *p = x <= 0 ? 0.0 : 1.0;
+        *q = 1.0 - *p;
+        return;
+    }
+    double front = exp(a * log(x) + b * log1p(-x) - log_beta);
+    if (x < (a + 1) / (a + b + 2)) {
+        *p = front * beta_continued_fraction(a, b, x) / a;
+        *q = 1.0 - *p;
+    } else {
+        *q = front * beta_continued_fraction(b, a, 1 - x) / b;
+        *p = 1.0 - *q;
+    }
+}
+
+static void lognormal_parameters(const Distribution* d, double* logmean, double* logstd)
+{
+    if (d->family == TO) {
+        *logmean = (log(d->a) + log(d->b)) / 2;
+        *logstd = (log(d->b) - log(d->a)) / (2 * NORMAL90CONFIDENCE);
+    } else {
+        *logmean = d->a;
+        *logstd = d->b;
+    }
+}
+
+static void cdf(const Distribution* d, double x, double* p, double* q)
+{
+    double z = 0.0, logmean, logstd;
+    switch (d->family) {
+    case UNIT_UNIFORM:
+        *p = x < 0 ? 0.0 : (x > 1 ? 1.0 : x);
+        *q = 1.0 - *p;
+        return;
+    case UNIT_NORMAL: z = x; break;
+    case NORMAL: z = (x - d->a) / d->b; break;
+    case LOGNORMAL:
+    case TO:
+        lognormal_parameters(d, &logmean, &logstd);
+        z = x > 0 ? (log(x) - logmean) / logstd : -INFINITY;
+        break;
+    case GAMMA: incomplete_gamma(d->a, d->log_normalization, x, p, q); return;
+    case BETA: incomplete_beta(d->a, d->b, d->log_normalization, x, p, q); return;
+    case MODEL: *p = *q = NAN; return;
+    }
+    *p = 0.5 * erfc(-z / M_SQRT2);
+    *q = 0.5 * erfc(z / M_SQRT2);
+}
+
+// Mean, variance and fourth central moment
+static void exact_moments(const Distribution* d, double* mean, double* variance, double* fourth_moment)
+{
+    double logmean, logstd, kurtosis = 3.0;
+    *mean = *variance = NAN; // for the sentinel model, which has no closed form, like its CDF
+    switch (d->family) {
+    case UNIT_UNIFORM:
+        *mean = 0.5;
+        *variance = 1.0 / 12;
+        kurtosis = 9.0 / 5;
+        break;
+    case UNIT_NORMAL:
+        *mean = 0.0;
+        *variance = 1.0;
+        break;
+    case NORMAL:
+        *mean = d->a;
+        *variance = d->b * d->b;
+        break;
+    case LOGNORMAL:
+    case TO: {
+        lognormal_parameters(d, &logmean, &logstd);
+        double s2 = logstd * logstd;
+        *mean = exp(logmean + s2 / 2);
+        *variance = expm1(s2) * exp(2 * logmean + s2);
+        kurtosis = exp(4 * s2) + 2 * exp(3 * s2) + 3 * exp(2 * s2) - 3;
+        break;
+    }
+    case GAMMA:
+        *mean = d->a;
+        *variance = d->a;
+        kurtosis = 3.0 + 6.0 / d->a;
+        break;
+    case BETA: {
+        double a = d->a, b = d->b;
+        *mean = a / (a + b);
+        *variance = a * b / ((a + b) * (a + b) * (a + b + 1));
+        kurtosis = 3.0 + 6.0 * ((a - b) * (a - b) * (a + b + 1) - a * b * (a + b + 2)) / (a * b * (a + b + 2) * (a + b + 3));
+        break;
+    }
+    case MODEL: break;
+    }
+    *fourth_moment = kurtosis * *variance * *variance;
+}
+
+/* Test statistics and their p-values */
+static double kolmogorov_p_value(double d, double n_effective)
+{
+    // Asymptotic Kolmogorov distribution, with Stephens' small sample correction
+    double lambda = (sqrt(n_effective) + 0.12 + 0.11 / sqrt(n_effective)) * d;
+    if (lambda < 0.2) return 1.0;
+    double sum = 0.0;
+    for (int j = 1; j <= 100; j++) {
+        sum += (j % 2 == 1 ? 2.0 : -2.0) * exp(-2.0 * j * j * lambda * lambda);
+    }
+    return sum < 0.0 ? 0.0 : (sum > 1.0 ? 1.0 : sum);
+}
+
+static double anderson_darling_p_value(double a2)
+{
+    // Asymptotic distribution of A^2, from Marsaglia & Marsaglia, 2004, "Evaluating the Anderson-Darling distribution"
+    if (a2 <= 0.0) return 1.0;
+    if (a2 < 2.0) {
+        return 1.0 - exp(-1.2337141 / a2) / sqrt(a2) * (2.00012 + (0.247105 - (0.0649821 - (0.0347962 - (0.011672 - 0.00168691 * a2) * a2) * a2) * a2) * a2);
+    }
+    return -expm1(-exp(1.0776 - (2.30695 - (0.43424 - (0.082433 - (0.008056 - 0.0003146 * a2) * a2) * a2) * a2) * a2));
+}
+
+// One sample KS statistic and Anderson-Darling A^2 of sorted xs against the exact CDF, in one pass
+static void one_sample_tests(const Distribution* d, double* xs, int64_t n, double* ks, double* a2)
+{
+    double max_distance = 0.0, sum = 0.0;
+    #pragma omp parallel for reduction(max : max_distance) reduction(+ : sum)
+    for (int64_t i = 0; i < n; i++) {
+        double p, q;
+        cdf(d, xs[i], &p, &q);
+        // Samples rounded onto the ends of the support, e.g., a beta of exactly 1.0, would otherwise make A^2 infinite
+        p = p > DBL_MIN ? p : DBL_MIN;
+        q = q > DBL_MIN ? q : DBL_MIN;
+        double below = p - (double)i / n;
+        double above = (double)(i + 1) / n - p;
+        double distance = below > above ? below : above;
+        if (distance > max_distance) max_distance = distance;
+        // A^2 = -n - 1/n sum (2i + 1) (log F(x_i) + log(1 - F(x_{n-1-i}))), regrouped by sample
+        sum += (2.0 * i + 1) * log(p) + (2.0 * (n - i) - 1) * log(q);
+    }
+    *ks = max_distance;
+    *a2 = -(double)n - sum / n;
+}
+
+// Two sample KS statistic of sorted xs and ys
+static double two_sample_ks(double* xs, int64_t n, double* ys, int64_t m)
+{
+    double max_distance = 0.0;
+    int64_t i = 0, j = 0;
+    while (i < n && j < m) {
+        double x = xs[i] < ys[j] ? xs[i] : ys[j];
+        while (i < n && xs[i] <= x) i++;
+        while (j < m && ys[j] <= x) j++;
+        double distance = fabs((double)i / n - (double)j / m);
+        if (distance > max_distance) max_distance = distance;
+    }
+    return max_distance;
+}
+
+/* Reports */
+typedef struct _Check {
+    double ns_per_sample; // thread time
+    double ks;
+    double ks_p;
+    double a2;
+    double a2_p;
+    double mean_z; // in standard errors
+    double variance_z;
+} Check;
+
+static const char* verdict(Check* check, double z_limit, int has_a2)
+{
+    int rejected = check->ks_p < ALPHA || (has_a2 && check->a2_p < ALPHA) || fabs(check->mean_z) > z_limit || fabs(check->variance_z) > z_limit;
+    return rejected ? "REJECT" : "ok";
+}
+
+static double samples_for_resolution(double z_limit, double per_sample_variance, double exact)
+{
+    // n such that the tolerance, z_limit * sqrt(per_sample_variance / n), is MOMENT_RESOLUTION * |exact|
+    double tolerance = MOMENT_RESOLUTION * fabs(exact);
+    return z_limit * z_limit * per_sample_variance / (tolerance * tolerance);
+}
+
+static void print_distribution(const Distribution* d, char* name, size_t size)
+{
+    switch (d->family) {
+    case UNIT_UNIFORM: snprintf(name, size, "unit_uniform"); break;
+    case UNIT_NORMAL: snprintf(name, size, "unit_normal"); break;
+    case NORMAL: snprintf(name, size, "normal(%g, %g)", d->a, d->b); break;
+    case LOGNORMAL: snprintf(name, size, "lognormal(%g, %g)", d->a, d->b); break;
+    case TO: snprintf(name, size, "to(%g, %g)", d->a, d->b); break;
+    case GAMMA: snprintf(name, size, "gamma(%g)", d->a); break;
+    case BETA: snprintf(name, size, "beta(%g, %g)", d->a, d->b); break;
+    case MODEL: snprintf(name, size, "sentinel model"); break;
+    }
+}
+
+int main()
+{
+    Distribution distributions[] = {
+        { .family = UNIT_UNIFORM },
+        { .family = UNIT_NORMAL },
+        { .family = NORMAL, .a = 10, .b = 3 },
+        { .family = LOGNORMAL, .a = 0, .b = 1 },
+        { .family = LOGNORMAL, .a = 0.644931, .b = 4.795860 }, // the lognormal of paper/index.md
+        { .family = TO, .a = 1, .b = 10 },
+        { .family = TO, .a = 0.01, .b = 100 },
+        { .family = GAMMA, .a = 0.5 },
+        { .family = GAMMA, .a = 1 },
+        { .family = GAMMA, .a = 2.5 },
+        { .family = GAMMA, .a = 20 },
+        { .family = BETA, .a = 0.5, .b = 0.5 },
+        { .family = BETA, .a = 2, .b = 20 }, // this and the following, as in the sentinel model
+        { .family = BETA, .a = 5, .b = 10 },
+        { .family = BETA, .a = 1, .b = 100 },
+        { .family = BETA, .a = 5, .b = 1000 },
+    };
+    Variant scalar = { "scalar", fill_scalar };
+    Variant batch = { "batch", fill_batch };
+    Variant fused = { "fused", fill_fused_model };
+    int n_distributions = (int)(sizeof(distributions) / sizeof(distributions[0]));
+    int n_threads = omp_get_max_threads();
+    double z_limit = 1.0 / sqrt(ALPHA); // Chebyshev: P(|z| > k) <= 1 / k^2
+    double* xs = (double*)malloc((size_t)N_SAMPLES * sizeof(double));
+    double* ys = (double*)malloc((size_t)N_SAMPLES * sizeof(double));
+    double* scratch = (double*)malloc((size_t)N_SAMPLES * sizeof(double));
+    memset(xs, 0, (size_t)N_SAMPLES * sizeof(double)); // so that the first timing doesn't include page faults
+    memset(ys, 0, (size_t)N_SAMPLES * sizeof(double));
+    memset(scratch, 0, (size_t)N_SAMPLES * sizeof(double));
+    int n_checks = 0, n_rejected = 0;
+#ifdef SQUIGGLE_LIBM
+    const char* kernels = "libm";
+#else
+    const char* kernels = "squiggle_math.h";
+#endif
+
+    printf("%ld samples per variant, on %d threads, with %s's exp, log, sin, cos and pow\n", (int64_t)N_SAMPLES, n_threads, kernels);
+    printf("Rejected if a KS or Anderson-Darling p-value is below %g, or if a moment is off by more than %.1f standard errors\n", ALPHA, z_limit);
+    for (int k = 0; k < n_distributions; k++) {
+        Distribution* d = &distributions[k];
+        if (d->family == GAMMA) d->log_normalization = lgamma(d->a);
+        if (d->family == BETA) d->log_normalization = lgamma(d->a) + lgamma(d->b) - lgamma(d->a + d->b);
+        double mean, variance, fourth_moment;
+        exact_moments(d, &mean, &variance, &fourth_moment);
+        char name[64];
+        print_distribution(d, name, sizeof(name));
+        printf("\n%s\n", name);
+        printf("  variant   ns/sample   speedup       KS D      KS p      AD A^2      AD p     mean z      var z   verdict\n");
+
+        int n_variants = d->family == UNIT_UNIFORM ? 1 : 2;
+        Variant* variants[] = { &scalar, &batch };
+        double scalar_ns = 0.0;
+        for (int v = 0; v < n_variants; v++) {
+            Check check;
+            double seconds = draw(variants[v], d, xs, N_SAMPLES, (uint64_t)(k * 16 + v + 1));
+            check.ns_per_sample = 1e9 * seconds * n_threads / N_SAMPLES;
+            if (v == 0) scalar_ns = check.ns_per_sample;
+            double sample_mean, sample_std;
+            array_mean_std(xs, N_SAMPLES, &sample_mean, &sample_std);
+            check.mean_z = (sample_mean - mean) / sqrt(variance / N_SAMPLES);
+            check.variance_z = (sample_std * sample_std - variance) / sqrt((fourth_moment - variance * variance) / N_SAMPLES);
+            parallel_sort(xs, scratch, N_SAMPLES);
+            one_sample_tests(d, xs, N_SAMPLES, &check.ks, &check.a2);
+            check.ks_p = kolmogorov_p_value(check.ks, N_SAMPLES);
+            check.a2_p = anderson_darling_p_value(check.a2);
+            const char* result = verdict(&check, z_limit, 1);
+            n_checks++;
+            n_rejected += result[0] == 'R';
+            printf("  %-8s %10.2f %8.2fx %10.2e %9.3g %11.3g %9.3g %10.2f %10.2f   %s\n", variants[v]->name, check.ns_per_sample, scalar_ns / check.ns_per_sample,
+                check.ks, check.ks_p, check.a2, check.a2_p, check.mean_z, check.variance_z, result);
+        }
+        // How much the moment checks can tell at this many samples
+        double mean_samples = samples_for_resolution(z_limit, variance, mean);
+        double variance_samples = samples_for_resolution(z_limit, fourth_moment - variance * variance, variance);
+        if (mean != 0.0 && mean_samples > N_SAMPLES) {
+            printf("  mean check: tolerance of %.3g, %.2g times the mean; it needs %.2g samples to get to %g\n", z_limit * sqrt(variance / N_SAMPLES),
+                z_limit * sqrt(variance / N_SAMPLES) / fabs(mean), mean_samples, MOMENT_RESOLUTION);
+        }
+        if (variance_samples > N_SAMPLES) {
+            printf("  variance check: tolerance of %.3g, %.2g times the variance; it needs %.2g samples to get to %g\n", z_limit * sqrt((fourth_moment - variance * variance) / N_SAMPLES),
+                z_limit * sqrt((fourth_moment - variance * variance) / N_SAMPLES) / variance, variance_samples, MOMENT_RESOLUTION);
+        }
+    }
+
+    // The model's fast versions against the scalar one: two sample KS, and means and variances within each other's standard errors
+    Distribution model = { .family = MODEL };
+    Variant* model_variants[] = { &fused, &batch };
+    printf("\nsentinel model, against the scalar version\n");
+    printf("  variant   ns/sample   speedup       KS D      KS p     mean z      var z   verdict\n");
+    double seconds = draw(&scalar, &model, ys, N_SAMPLES, 1000);
+    double scalar_ns = 1e9 * seconds * n_threads / N_SAMPLES;
+    double scalar_mean, scalar_std;
+    array_mean_std(ys, N_SAMPLES, &scalar_mean, &scalar_std);
+    double scalar_fourth_moment = 0.0;
+    for (int64_t i = 0; i < N_SAMPLES; i++) {
+        double deviation = (ys[i] - scalar_mean) * (ys[i] - scalar_mean);
+        scalar_fourth_moment += deviation * deviation / N_SAMPLES;
+    }
+    parallel_sort(ys, scratch, N_SAMPLES);
+    printf("  %-8s %10.2f %8.2fx\n", scalar.name, scalar_ns, 1.0);
+    for (int v = 0; v < 2; v++) {
+        Check check = { 0 };
+        seconds = draw(model_variants[v], &model, xs, N_SAMPLES, (uint64_t)(1001 + v));
+        check.ns_per_sample = 1e9 * seconds * n_threads / N_SAMPLES;
+        double sample_mean, sample_std;
+        array_mean_std(xs, N_SAMPLES, &sample_mean, &sample_std);
+        // Without exact moments, standard errors from the scalar version's samples, for both
+        double scalar_variance = scalar_std * scalar_std;
+        check.mean_z = (sample_mean - scalar_mean) / sqrt(2 * scalar_variance / N_SAMPLES);
+        check.variance_z = (sample_std * sample_std - scalar_variance) / sqrt(2 * (scalar_fourth_moment - scalar_variance * scalar_variance) / N_SAMPLES);
+        parallel_sort(xs, scratch, N_SAMPLES);
+        check.ks = two_sample_ks(xs, N_SAMPLES, ys, N_SAMPLES);
+        check.ks_p = kolmogorov_p_value(check.ks, N_SAMPLES / 2.0);
+        check.a2_p = 1.0;
+        const char* result = verdict(&check, z_limit, 0);
+        n_checks++;
+        n_rejected += result[0] == 'R';
+        printf("  %-8s %10.2f %8.2fx %10.2e %9.3g %10.2f %10.2f   %s\n", model_variants[v]->name, check.ns_per_sample, scalar_ns / check.ns_per_sample,
+            check.ks, check.ks_p, check.mean_z, check.variance_z, result);
+    }
+
+    printf("\n%d of %d variants rejected\n", n_rejected, n_checks);
+    free(xs);
+    free(ys);
+    free(scratch);
+    return n_rejected > 0;
+}
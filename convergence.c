@@ -0,0 +1,203 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "convergence.h"
+
+/*
+Batch means: split the samples of a checkpoint into CONVERGENCE_N_BATCHES contiguous batches, and take
+the spread of a statistic across batches as its sampling error, std. error = sd(batch statistics) / sqrt(n_batches).
+See e.g., Asmussen & Glynn, 2007, "Stochastic Simulation: Algorithms and Analysis", ch. IV.5
+
+With 10 batches, the batches of checkpoint k + 1 are blocks of the size of the whole checkpoint k.
+So each sample is only added once, to a first level block; completed blocks are merged up one level at a time.
+*/
+
+#define CONVERGENCE_BLOCKS_PER_GROUP 1024 // first level blocks summarized in parallel at a time
+
+Convergence convergence_init(uint64_t n_processes, uint64_t process_index)
+{
+    Convergence convergence;
+    memset(&convergence, 0, sizeof(Convergence));
+    // The first processes take one more sample each, so that the shares add up to the batch size
+    uint64_t batch_size = (uint64_t)CONVERGENCE_FIRST_CHECKPOINT / CONVERGENCE_N_BATCHES;
+    convergence.block_size = batch_size / n_processes + (process_index < batch_size % n_processes ? 1 : 0);
+    if (convergence.block_size == 0) {
+        // More processes than samples in a batch: this one has no share, and its empty batches are complete from the start
+        for (int k = 0; k < CONVERGENCE_N_CHECKPOINTS; k++) {
+            convergence.n_blocks[k] = CONVERGENCE_N_BATCHES;
+        }
+    }
+    return convergence;
+}
+
+static void batch_stats_merge(Batch_stats* accumulator, Batch_stats* new)
+{
+    // Chan et al., 1979, "Updating formulae and a pairwise algorithm for computing sample variances"
+    if (new->n_samples == 0) return;
+    uint64_t n = accumulator->n_samples + new->n_samples;
+    double delta = new->mean - accumulator->mean;
+    accumulator->mean += delta * (double)new->n_samples / (double)n;
+    accumulator->m2 += new->m2 + delta * delta * (double)accumulator->n_samples * (double)new->n_samples / (double)n;
+    accumulator->n_samples = n;
+    for (int t = 0; t < CONVERGENCE_N_THRESHOLDS; t++) {
+        accumulator->n_above[t] += new->n_above[t];
+    }
+}
+
+static Batch_stats batch_stats_of(double* xs, int n)
+{
+    Batch_stats stats;
+    memset(&stats, 0, sizeof(Batch_stats));
+    if (n == 0) return stats;
+    double sum = 0.0;
+    for (int k = 0; k < n; k++) {
+        sum += xs[k];
+    }
+    stats.n_samples = n;
+    stats.mean = sum / n;
+    for (int k = 0; k < n; k++) {
+        stats.m2 += (xs[k] - stats.mean) * (xs[k] - stats.mean);
+        for (int t = 0; t < CONVERGENCE_N_THRESHOLDS; t++) {
+            stats.n_above[t] += xs[k] > CONVERGENCE_THRESHOLDS[t];
+        }
+    }
+    return stats;
+}
+
+static void push_block(Convergence* convergence, int level, Batch_stats* block)
+{
+    if (convergence->n_blocks[level] < CONVERGENCE_N_BATCHES) {
+        convergence->batches[level][convergence->n_blocks[level]] = *block;
+    }
+    convergence->n_blocks[level]++;
+    if (level + 1 >= CONVERGENCE_N_CHECKPOINTS) return;
+    batch_stats_merge(&convergence->current[level + 1], block);
+    if (convergence->current[level + 1].n_samples == convergence->block_size * (uint64_t)pow(CONVERGENCE_N_BATCHES, level + 1)) {
+        Batch_stats completed = convergence->current[level + 1];
+        memset(&convergence->current[level + 1], 0, sizeof(Batch_stats));
+        push_block(convergence, level + 1, &completed);
+    }
+}
+
+void convergence_add_chunk(Convergence* convergence, double* xs, int64_t n_samples)
+{
+    if (convergence->n_blocks[CONVERGENCE_N_CHECKPOINTS - 1] >= CONVERGENCE_N_BATCHES) return; // all checkpoints done
+    int block_size = (int)convergence->block_size;
+
+    // First, complete the block left over from the last chunk
+    int64_t start = 0;
+    if (convergence->partial.n_samples > 0) {
+        int missing = block_size - (int)convergence->partial.n_samples;
+        start = missing < n_samples ? missing : n_samples;
+        Batch_stats head = batch_stats_of(xs, (int)start);
+        batch_stats_merge(&convergence->partial, &head);
+        if ((int)convergence->partial.n_samples == block_size) {
+            Batch_stats completed = convergence->partial;
+            memset(&convergence->partial, 0, sizeof(Batch_stats));
+            push_block(convergence, 0, &completed);
+        }
+    }
+
+    // Then whole blocks, summarized in parallel and pushed in order
+    int64_t n_blocks = (n_samples - start) / block_size;
+    Batch_stats blocks[CONVERGENCE_BLOCKS_PER_GROUP];
+    for (int64_t group = 0; group < n_blocks; group += CONVERGENCE_BLOCKS_PER_GROUP) {
+        int n_group = (n_blocks - group) < CONVERGENCE_BLOCKS_PER_GROUP ? (n_blocks - group) : CONVERGENCE_BLOCKS_PER_GROUP;
+        #pragma omp parallel for
+        for (int b = 0; b < n_group; b++) {
+            blocks[b] = batch_stats_of(xs + start + (int64_t)(group + b) * block_size, block_size);
+        }
+        for (int b = 0; b < n_group; b++) {
+            push_block(convergence, 0, &blocks[b]);
+        }
+    }
+
+    // And keep the rest for the next chunk
+    int64_t end = start + n_blocks * block_size;
+    if (end < n_samples) {
+        Batch_stats tail = batch_stats_of(xs + end, (int)(n_samples - end));
+        batch_stats_merge(&convergence->partial, &tail);
+    }
+}
+
+void convergence_merge(Convergence* accumulator, Convergence* new)
+{
+    // A checkpoint is only complete once it is complete on every process, so keep the smaller count
+    for (int k = 0; k < CONVERGENCE_N_CHECKPOINTS; k++) {
+        for (int b = 0; b < CONVERGENCE_N_BATCHES; b++) {
+            batch_stats_merge(&accumulator->batches[k][b], &new->batches[k][b]);
+        }
+        if (accumulator->n_blocks[k] > new->n_blocks[k]) accumulator->n_blocks[k] = new->n_blocks[k];
+    }
+}
+
+static void mean_and_std_error(double* values, int n, double* mean, double* std_error)
+{
+    double sum = 0.0;
+    for (int b = 0; b < n; b++) {
+        sum += values[b];
+    }
+    *mean = sum / n;
+    double sum_squares = 0.0;
+    for (int b = 0; b < n; b++) {
+        sum_squares += (values[b] - *mean) * (values[b] - *mean);
+    }
+    *std_error = sqrt(sum_squares / (n - 1) / n);
+}
+
+void print_convergence(Convergence* process_convergences, int n_processes)
+{
+    int n_complete = 0;
+    while (n_complete < CONVERGENCE_N_CHECKPOINTS) {
+        int complete = 1;
+        for (int p = 0; p < n_processes; p++) {
+            complete = complete && process_convergences[p].n_blocks[n_complete] >= CONVERGENCE_N_BATCHES;
+        }
+        if (!complete) break;
+        n_complete++;
+    }
+    if (n_complete == 0) return;
+
+    printf("Convergence (± std. error from %d batch means) {\n", CONVERGENCE_N_BATCHES);
+    printf("  %-10s  %-24s  %-24s", "N_samples", "Mean", "Var");
+    for (int t = 0; t < CONVERGENCE_N_THRESHOLDS; t++) {
+        char label[32];
+        snprintf(label, sizeof(label), "P(X > %g)", CONVERGENCE_THRESHOLDS[t]);
+        printf("  %-21s", label);
+    }
+    printf("\n");
+    for (int k = 0; k < n_complete; k++) {
+        // Batch b of checkpoint k is made up of batch b of each process
+        double batch_means[CONVERGENCE_N_BATCHES];
+        double batch_variances[CONVERGENCE_N_BATCHES];
+        double batch_frequencies[CONVERGENCE_N_THRESHOLDS][CONVERGENCE_N_BATCHES];
+        Batch_stats total;
+        memset(&total, 0, sizeof(Batch_stats));
+        for (int b = 0; b < CONVERGENCE_N_BATCHES; b++) {
+            Batch_stats batch;
+            memset(&batch, 0, sizeof(Batch_stats));
+            for (int p = 0; p < n_processes; p++) {
+                batch_stats_merge(&batch, &process_convergences[p].batches[k][b]);
+            }
+            batch_stats_merge(&total, &batch);
+            batch_means[b] = batch.mean;
+            batch_variances[b] = batch.m2 / (double)batch.n_samples;
+            for (int t = 0; t < CONVERGENCE_N_THRESHOLDS; t++) {
+                batch_frequencies[t][b] = (double)batch.n_above[t] / (double)batch.n_samples;
+            }
+        }
+        double mean, mean_std_error, variance, variance_std_error;
+        mean_and_std_error(batch_means, CONVERGENCE_N_BATCHES, &mean, &mean_std_error);
+        mean_and_std_error(batch_variances, CONVERGENCE_N_BATCHES, &variance, &variance_std_error);
+        variance = total.m2 / (double)total.n_samples; // the average of the batch variances leaves out the spread between batches
+        printf("  %-10.3e  %12.8lf ± %-9.2e  %12.6lf ± %-9.2e", (double)total.n_samples, total.mean, mean_std_error, variance, variance_std_error);
+        for (int t = 0; t < CONVERGENCE_N_THRESHOLDS; t++) {
+            double frequency, frequency_std_error;
+            mean_and_std_error(batch_frequencies[t], CONVERGENCE_N_BATCHES, &frequency, &frequency_std_error);
+            printf("  %.3e ± %-9.2e", frequency, frequency_std_error);
+        }
+        printf("\n");
+    }
+    printf("}\n");
+}
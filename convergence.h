@@ -0,0 +1,42 @@
+#ifndef FINISTERRAE_CONVERGENCE
+#define FINISTERRAE_CONVERGENCE
+
+#include <stdint.h>
+
+/* Convergence trace: stats at 10^6, 10^7, ..., 10^12 samples, with batch-means standard errors */
+
+#define CONVERGENCE_N_CHECKPOINTS 7 // 10^6 to 10^12 samples
+#define CONVERGENCE_FIRST_CHECKPOINT 1000000
+#define CONVERGENCE_N_BATCHES 10 // so that the batches of one checkpoint are the whole of the previous one
+#define CONVERGENCE_N_THRESHOLDS 3
+static const double CONVERGENCE_THRESHOLDS[CONVERGENCE_N_THRESHOLDS] = { 1, 10, 100 }; // tail frequencies P(X > threshold)
+
+typedef struct _Batch_stats {
+    uint64_t n_samples;
+    double mean;
+    double m2; // sum of squared deviations from the mean
+    uint64_t n_above[CONVERGENCE_N_THRESHOLDS];
+} Batch_stats;
+
+/*
+Each process keeps the first CONVERGENCE_N_BATCHES blocks of its share of each checkpoint's batch size.
+Shares differ by at most one sample between processes, and add up to the batch size exactly.
+Checkpoint k takes a prefix of every process, so its batches merge across processes.
+Batches are added up in sample order, so they don't depend on the threads. Their merges are plain double updates, in rank
+order, or node by node with node aggregation, so the last bits of the merged batches depend on that.
+Fixed size, so that it can be gathered over MPI as a flat struct.
+*/
+typedef struct _Convergence {
+    uint64_t block_size; // this process's share of the first checkpoint's batch size; batch size grows 10x per checkpoint
+    int n_blocks[CONVERGENCE_N_CHECKPOINTS];
+    Batch_stats batches[CONVERGENCE_N_CHECKPOINTS][CONVERGENCE_N_BATCHES];
+    Batch_stats current[CONVERGENCE_N_CHECKPOINTS]; // block being filled up at each level, from blocks one level below
+    Batch_stats partial; // samples left over at the end of a chunk, which haven't filled a first level block yet
+} Convergence;
+
+Convergence convergence_init(uint64_t n_processes, uint64_t process_index);
+void convergence_add_chunk(Convergence* convergence, double* xs, int64_t n_samples);
+void convergence_merge(Convergence* accumulator, Convergence* new); // of the same checkpoints on two groups of processes
+void print_convergence(Convergence* process_convergences, int n_processes);
+
+#endif
@@ -0,0 +1,60 @@
+#include <math.h>
+#include <string.h>
+
+#include "exact_sum.h"
+
+Exact_sum exact_sum_init(void)
+{
+    Exact_sum sum;
+    memset(&sum, 0, sizeof(sum));
+    return sum;
+}
+
+void exact_sum_normalize(Exact_sum* sum)
+{
+    // Every chunk but the last into [0, 2^32), carrying the rest upwards. The result is unique for a given value
+    for (int i = 0; i < EXACT_SUM_N_CHUNKS - 1; i++) {
+        int64_t carry = sum->chunks[i] >> 32; // arithmetic shift: rounds towards -inf, so that what stays is non-negative
+        sum->chunks[i] -= carry * ((int64_t)1 << 32);
+        sum->chunks[i + 1] += carry;
+    }
+    sum->n_unnormalized = 0;
+}
+
+void exact_sum_merge(Exact_sum* accumulator, const Exact_sum* new)
+{
+    // Normalized chunks are below 2^32 in absolute value, so this counts as one more addition to each
+    Exact_sum normalized = *new;
+    exact_sum_normalize(&normalized);
+    if (accumulator->n_unnormalized + 1 >= EXACT_SUM_MAX_UNNORMALIZED) exact_sum_normalize(accumulator);
+    for (int i = 0; i < EXACT_SUM_N_CHUNKS; i++) {
+        accumulator->chunks[i] += normalized.chunks[i];
+    }
+    accumulator->n_unnormalized++;
+    accumulator->non_finite += new->non_finite;
+}
+
+double exact_sum_value(const Exact_sum* sum)
+{
+    if (sum->non_finite != 0.0 || isnan(sum->non_finite)) return sum->non_finite;
+    Exact_sum magnitude = *sum;
+    exact_sum_normalize(&magnitude);
+    // In sign and magnitude, so that the leading chunk is at least 1 and the three leading ones carry 64 bits or more
+    double sign = 1.0;
+    if (magnitude.chunks[EXACT_SUM_N_CHUNKS - 1] < 0) {
+        sign = -1.0;
+        for (int i = 0; i < EXACT_SUM_N_CHUNKS; i++) {
+            magnitude.chunks[i] = -magnitude.chunks[i];
+        }
+        exact_sum_normalize(&magnitude);
+    }
+    int top = EXACT_SUM_N_CHUNKS - 1;
+    while (top > 0 && magnitude.chunks[top] == 0) {
+        top--;
+    }
+    double value = 0.0;
+    for (int i = top; i >= 0 && i > top - 3; i--) {
+        value += ldexp((double)magnitude.chunks[i], 32 * i - 1074);
+    }
+    return sign * value;
+}
@@ -0,0 +1,62 @@
+#ifndef FINISTERRAE_EXACT_SUM
+#define FINISTERRAE_EXACT_SUM
+
+#include <stdint.h>
+
+/* Exact sums of doubles, which don't depend on the order in which terms are added or accumulators merged */
+
+/*
+A fixed point number with one bit per power of two a double can hold, 2^-1074 to 2^1023, and room above for carries,
+in 32-bit digits held in int64_t chunks, as in Neal's small superaccumulator <https://arxiv.org/abs/1505.05571>.
+A double adds its 53-bit mantissa, shifted into place, to three chunks; chunks absorb 2^31 such additions before
+their carries have to be propagated. Integer additions are exact and commute, so any tree of merges gives the same sum.
+Fixed size, so that stats can be gathered over MPI as a flat struct.
+*/
+#define EXACT_SUM_N_CHUNKS 67
+#define EXACT_SUM_MAX_UNNORMALIZED ((int64_t)1 << 30)
+
+typedef struct _Exact_sum {
+    int64_t chunks[EXACT_SUM_N_CHUNKS]; // chunks[i] is worth chunks[i] * 2^(32 i - 1074)
+    int64_t n_unnormalized; // additions since carries were last propagated
+    double non_finite; // sum of infinities and NaNs, which have no fixed point form
+} Exact_sum;
+
+Exact_sum exact_sum_init(void);
+void exact_sum_normalize(Exact_sum* sum);
+static inline void exact_sum_add(Exact_sum* sum, double x)
+{
+    union {
+        double x;
+        uint64_t bits;
+    } u = { .x = x };
+    int exponent = (int)((u.bits >> 52) & 0x7ff);
+    if (exponent == 0x7ff) {
+        sum->non_finite += x;
+        return;
+    }
+    // x = mantissa * 2^(position - 1074), subnormals included
+    uint64_t mantissa = u.bits & 0x000fffffffffffffULL;
+    int position = 0;
+    if (exponent > 0) {
+        mantissa |= 0x0010000000000000ULL;
+        position = exponent - 1;
+    }
+    unsigned __int128 shifted = (unsigned __int128)mantissa << (position & 31);
+    int chunk = position >> 5;
+    int64_t low = (int64_t)(uint32_t)shifted;
+    int64_t middle = (int64_t)(uint32_t)(shifted >> 32);
+    int64_t high = (int64_t)(shifted >> 64);
+    if (u.bits >> 63) {
+        low = -low;
+        middle = -middle;
+        high = -high;
+    }
+    sum->chunks[chunk] += low;
+    sum->chunks[chunk + 1] += middle;
+    sum->chunks[chunk + 2] += high;
+    if (++sum->n_unnormalized >= EXACT_SUM_MAX_UNNORMALIZED) exact_sum_normalize(sum);
+}
+void exact_sum_merge(Exact_sum* accumulator, const Exact_sum* new);
+double exact_sum_value(const Exact_sum* sum); // rounded to a double, within 1 ulp, and always the same double for the same exact sum
+
+#endif
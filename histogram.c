@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+#include "squiggle_c/squiggle_more.h"
+
+#define HISTOGRAM_MIN_TAIL_CAPACITY 64
+
+typedef struct _Bin_count {
+    int bin;
+    uint64_t count;
+} Bin_count;
+
+static void check_allocation(const void* pointer)
+{
+    // Histograms are filled inside the sampling loop, which has no way to recover from a missing buffer
+    if (pointer == NULL) {
+        fprintf(stderr, "Memory allocation for histogram failed\n");
+        exit(1);
+    }
+}
+
+Histogram histogram_init(double min, double sup, double bin_width, int n_bins)
+{
+    Histogram histogram = {
+        .min = min,
+        .sup = sup,
+        .bin_width = bin_width,
+        .n_bins = n_bins,
+        .n_dense = n_bins < HISTOGRAM_MAX_DENSE_BINS ? n_bins : HISTOGRAM_MAX_DENSE_BINS,
+        .tail_bins = NULL,
+        .tail_counts = NULL,
+        .tail_capacity = 0,
+        .tail_n = 0,
+    };
+    histogram.dense = (uint64_t*)calloc((size_t)histogram.n_dense, sizeof(uint64_t));
+    check_allocation(histogram.dense);
+    return histogram;
+}
+
+void histogram_free(Histogram* histogram)
+{
+    free(histogram->dense);
+    free(histogram->tail_bins);
+    free(histogram->tail_counts);
+}
+
+void histogram_clear(Histogram* histogram)
+{
+    // Keeps the tail's capacity, as the next iteration will likely hit as many bins
+    memset(histogram->dense, 0, (size_t)histogram->n_dense * sizeof(uint64_t));
+    if (histogram->tail_n > 0) {
+        memset(histogram->tail_bins, 0xff, (size_t)histogram->tail_capacity * sizeof(int));
+        histogram->tail_n = 0;
+    }
+}
+
+/* Tail: linear probing, with Fibonacci hashing of the bin index */
+static int tail_slot(Histogram* histogram, int bin)
+{
+    int mask = histogram->tail_capacity - 1;
+    int slot = (int)(((uint64_t)(unsigned)bin * 0x9E3779B97F4A7C15ULL) >> 40) & mask;
+    while (histogram->tail_bins[slot] != -1 && histogram->tail_bins[slot] != bin) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void tail_grow(Histogram* histogram)
+{
+    int old_capacity = histogram->tail_capacity;
+    int* old_bins = histogram->tail_bins;
+    uint64_t* old_counts = histogram->tail_counts;
+    histogram->tail_capacity = old_capacity > 0 ? 2 * old_capacity : HISTOGRAM_MIN_TAIL_CAPACITY;
+    histogram->tail_bins = (int*)malloc((size_t)histogram->tail_capacity * sizeof(int));
+    histogram->tail_counts = (uint64_t*)malloc((size_t)histogram->tail_capacity * sizeof(uint64_t));
+    check_allocation(histogram->tail_bins);
+    check_allocation(histogram->tail_counts);
+    memset(histogram->tail_bins, 0xff, (size_t)histogram->tail_capacity * sizeof(int));
+    for (int i = 0; i < old_capacity; i++) {
+        if (old_bins[i] != -1) {
+            int slot = tail_slot(histogram, old_bins[i]);
+            histogram->tail_bins[slot] = old_bins[i];
+            histogram->tail_counts[slot] = old_counts[i];
+        }
+    }
+    free(old_bins);
+    free(old_counts);
+}
+
+void histogram_add_to_tail(Histogram* histogram, int bin, uint64_t count)
+{
+    if (bin < histogram->n_dense || bin >= histogram->n_bins) return;
+    if (4 * (histogram->tail_n + 1) > 3 * histogram->tail_capacity) tail_grow(histogram); // load factor of at most 3/4
+    int slot = tail_slot(histogram, bin);
+    if (histogram->tail_bins[slot] == -1) {
+        histogram->tail_bins[slot] = bin;
+        histogram->tail_counts[slot] = 0;
+        histogram->tail_n++;
+    }
+    histogram->tail_counts[slot] += count;
+}
+
+uint64_t histogram_count(Histogram* histogram, int bin)
+{
+    if ((unsigned)bin < (unsigned)histogram->n_dense) return histogram->dense[bin];
+    if (histogram->tail_n == 0) return 0;
+    int slot = tail_slot(histogram, bin);
+    return histogram->tail_bins[slot] == bin ? histogram->tail_counts[slot] : 0;
+}
+
+static int compare_bins(const void* a, const void* b)
+{
+    int x = ((const Bin_count*)a)->bin;
+    int y = ((const Bin_count*)b)->bin;
+    return (x > y) - (x < y);
+}
+
+static Bin_count* sorted_tail(Histogram* histogram)
+{
+    Bin_count* tail = (Bin_count*)malloc((size_t)(histogram->tail_n > 0 ? histogram->tail_n : 1) * sizeof(Bin_count));
+    check_allocation(tail);
+    int n = 0;
+    for (int i = 0; i < histogram->tail_capacity; i++) {
+        if (histogram->tail_bins[i] != -1) {
+            tail[n++] = (Bin_count) { .bin = histogram->tail_bins[i], .count = histogram->tail_counts[i] };
+        }
+    }
+    qsort(tail, (size_t)n, sizeof(Bin_count), compare_bins);
+    return tail;
+}
+
+/* Serialization */
+#define VARINT_MAX_BYTES 10
+
+static size_t write_varint(unsigned char* buffer, uint64_t x)
+{
+    size_t n = 0;
+    while (x >= 0x80) {
+        buffer[n++] = (unsigned char)(x | 0x80);
+        x >>= 7;
+    }
+    buffer[n++] = (unsigned char)x;
+    return n;
+}
+
+static int read_varint(const unsigned char* buffer, size_t size, size_t* position, uint64_t* x)
+{
+    *x = 0;
+    for (int shift = 0; shift < 64 && *position < size; shift += 7) {
+        unsigned char byte = buffer[(*position)++];
+        *x |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return 0;
+    }
+    return 1;
+}
+
+size_t histogram_serialized_size_bound(Histogram* histogram)
+{
+    size_t n_populated = (size_t)histogram->tail_n;
+    for (int i = 0; i < histogram->n_dense; i++) {
+        n_populated += histogram->dense[i] != 0;
+    }
+    return VARINT_MAX_BYTES * (1 + 2 * n_populated);
+}
+
+size_t histogram_serialize(Histogram* histogram, unsigned char* buffer)
+{
+    uint64_t n_populated = (uint64_t)histogram->tail_n;
+    for (int i = 0; i < histogram->n_dense; i++) {
+        n_populated += histogram->dense[i] != 0;
+    }
+    size_t size = write_varint(buffer, n_populated);
+    int previous = -1;
+    for (int i = 0; i < histogram->n_dense; i++) {
+        if (histogram->dense[i] != 0) {
+            size += write_varint(buffer + size, (uint64_t)(i - previous));
+            size += write_varint(buffer + size, histogram->dense[i]);
+            previous = i;
+        }
+    }
+    Bin_count* tail = sorted_tail(histogram);
+    for (int i = 0; i < histogram->tail_n; i++) {
+        size += write_varint(buffer + size, (uint64_t)(tail[i].bin - previous));
+        size += write_varint(buffer + size, tail[i].count);
+        previous = tail[i].bin;
+    }
+    free(tail);
+    return size;
+}
+
+int histogram_merge_serialized(Histogram* accumulator, const unsigned char* buffer, size_t size)
+{
+    size_t position = 0;
+    uint64_t n_populated;
+    if (read_varint(buffer, size, &position, &n_populated)) return 1;
+    int64_t bin = -1;
+    for (uint64_t i = 0; i < n_populated; i++) {
+        uint64_t gap, count;
+        if (read_varint(buffer, size, &position, &gap) || read_varint(buffer, size, &position, &count)) return 1;
+        // A gap past the last bin, including one that would overflow bin, means a malformed buffer
+        if (gap == 0 || gap > (uint64_t)(accumulator->n_bins - 1 - bin)) return 1;
+        bin += (int64_t)gap;
+        histogram_add(accumulator, (int)bin, count);
+    }
+    return position != size;
+}
+
+/* Printing */
+void histogram_print(Histogram* histogram)
+{
+    uint64_t total_count = 0;
+    uint64_t max_count = 0;
+    for (int i = 0; i < histogram->n_dense; i++) {
+        total_count += histogram->dense[i];
+        if (histogram->dense[i] > max_count) max_count = histogram->dense[i];
+    }
+    Bin_count* tail = sorted_tail(histogram);
+    for (int i = 0; i < histogram->tail_n; i++) {
+        total_count += tail[i].count;
+        if (tail[i].count > max_count) max_count = tail[i].count;
+    }
+    double scale = max_count > HISTOGRAM_MAX_WIDTH ? (double)HISTOGRAM_MAX_WIDTH / max_count : 1.0;
+    for (int i = 0; i < histogram->n_dense; i++) {
+        if (histogram->dense[i] != 0) print_histogram_bin(histogram->min + i * histogram->bin_width, histogram->bin_width, histogram->dense[i], total_count, scale);
+    }
+    for (int i = 0; i < histogram->tail_n; i++) {
+        print_histogram_bin(histogram->min + tail[i].bin * histogram->bin_width, histogram->bin_width, tail[i].count, total_count, scale);
+    }
+    free(tail);
+}
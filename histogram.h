@@ -0,0 +1,51 @@
+#ifndef FINISTERRAE_HISTOGRAM
+#define FINISTERRAE_HISTOGRAM
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Two-level histogram: dense counts for the body, a hash table for the sparse tail, and a compressed form for MPI */
+
+/*
+Bins [0, n_dense) are a plain array, and bins [n_dense, n_bins) live in an open addressing hash table, only once they have been hit.
+So 10^7 bins of width 0.01 cost HISTOGRAM_MAX_DENSE_BINS * 8 bytes, plus 16 bytes per populated bin past them, rather than 80 MB.
+Serialized, a histogram is its number of populated bins, then, for each in order, the gap from the previous one and its count, as LEB128 varints:
+about two bytes per bin in the body, and a few more in the tail.
+*/
+#define HISTOGRAM_MAX_DENSE_BINS 65536
+
+typedef struct _Histogram {
+    double min;
+    double sup;
+    double bin_width;
+    int n_bins;
+    int n_dense;
+    uint64_t* dense;
+    int* tail_bins; // hash table keys, -1 if empty
+    uint64_t* tail_counts;
+    int tail_capacity; // a power of 2, or 0 before the tail is first hit
+    int tail_n; // populated tail bins
+} Histogram;
+
+Histogram histogram_init(double min, double sup, double bin_width, int n_bins);
+void histogram_free(Histogram* histogram);
+void histogram_clear(Histogram* histogram);
+void histogram_add_to_tail(Histogram* histogram, int bin, uint64_t count);
+static inline void histogram_add(Histogram* histogram, int bin, uint64_t count)
+{
+    // Bins outside [0, n_bins) are dropped
+    if ((unsigned)bin < (unsigned)histogram->n_dense) {
+        histogram->dense[bin] += count;
+    } else {
+        histogram_add_to_tail(histogram, bin, count);
+    }
+}
+uint64_t histogram_count(Histogram* histogram, int bin);
+
+size_t histogram_serialized_size_bound(Histogram* histogram);
+size_t histogram_serialize(Histogram* histogram, unsigned char* buffer); // buffer must have histogram_serialized_size_bound bytes; returns the bytes written
+int histogram_merge_serialized(Histogram* accumulator, const unsigned char* buffer, size_t size); // returns 1 if the buffer is malformed
+
+void histogram_print(Histogram* histogram); // populated bins only, with print_histogram's lines
+
+#endif
@@ -5,7 +5,7 @@
 #SBATCH -n 4 #(4 MPI processes)
 #SBATCH --ntasks-per-node=1 #(1 process per node, so 4 nodes)
 #SBATCH --cpus-per-task=64
-#SBATCH --mem 100GB
+#SBATCH --mem 100GB #(per node; the chunk of samples per iteration is sized to fit it, see memory_budget_per_process in samples.c)
 #SBATCH --mail-type=begin #Envía un correo cuando el trabajo inicia
 #SBATCH --mail-type=end #Envía un correo cuando el trabajo finaliza
 #SBATCH --mail-type=fail
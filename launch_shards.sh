@@ -0,0 +1,18 @@
+#!/bin/bash
+#SBATCH -o shards/samples-%A_%a.out
+#SBATCH -e shards/samples-%A_%a.err
+#SBATCH -t 0-04:00:00 #short tasks fit in backfill slots
+#SBATCH --array=0-999 #1000 shards, of 1/1000 of N_SAMPLES_TOTAL each
+#SBATCH -n 1 #(1 process per shard, no MPI needed)
+#SBATCH --cpus-per-task=64
+#SBATCH --mem 100GB
+
+# Build once, before submitting, rather than in each task:
+#   mkdir -p shards && make release-linux && sbatch launch_shards.sh
+# Then, once the tasks are done, on any node, with the same build:
+#   ./samples --merge shards/shard-*.bin
+# Failed or missing shards can be rerun on their own, e.g., sbatch --array=17,42 launch_shards.sh; the merge lists missing ones.
+# So the shard count is fixed here, rather than taken from SLURM_ARRAY_TASK_COUNT, which would be 2 for such a rerun
+N_SHARDS=1000
+
+./samples --shard $SLURM_ARRAY_TASK_ID $N_SHARDS shards/shard-$SLURM_ARRAY_TASK_ID.bin
@@ -1,32 +1,186 @@
 #include "model.h"
 
-double sample_cost_effectiveness_sentinel_bps_per_million(uint64_t * seed){
-    double total_amount_xrisk = sample_beta(2, 20, seed);
-    double black_swans_per_decade = sample_to(1, 7, seed);
-    double chance_we_can_identify_black_swan_a_week_to_two_months_beforehand = sample_beta(5,10, seed);
-    
-    double chance_black_swan_is_existential = sample_beta(1, 100, seed);
-    double chance_we_can_avert_or_mitigate_existential_risk = sample_beta(5, 1 * THOUSAND, seed);
+static const char* const sentinel_input_names[N_SENTINEL_INPUTS] = {
+    "total_amount_xrisk",
+    "black_swans_per_decade",
+    "chance_we_can_identify_black_swan_a_week_to_two_months_beforehand",
+    "chance_black_swan_is_existential",
+    "chance_we_can_avert_or_mitigate_existential_risk",
+    "chance_black_swan_is_catastrophic",
+    "chance_we_can_avert_or_mitigate_catastrophic_risk",
+    "catastrophic_to_existential_conversion_factor",
+    "cost_of_sentinel_per_year",
+};
+
+static void sample_sentinel_inputs(double* inputs, uint64_t* seed)
+{
+    inputs[TOTAL_AMOUNT_XRISK] = sample_beta(2, 20, seed);
+    inputs[BLACK_SWANS_PER_DECADE] = sample_to(1, 7, seed);
+    inputs[CHANCE_WE_CAN_IDENTIFY_BLACK_SWAN] = sample_beta(5,10, seed);
+
+    inputs[CHANCE_BLACK_SWAN_IS_EXISTENTIAL] = sample_beta(1, 100, seed);
+    inputs[CHANCE_WE_CAN_AVERT_OR_MITIGATE_EXISTENTIAL_RISK] = sample_beta(5, 1 * THOUSAND, seed);
+
+    inputs[CHANCE_BLACK_SWAN_IS_CATASTROPHIC] = sample_beta(3, 100, seed);
+    inputs[CHANCE_WE_CAN_AVERT_OR_MITIGATE_CATASTROPHIC_RISK] = sample_beta(2, 100, seed);
+
+    inputs[CATASTROPHIC_TO_EXISTENTIAL_CONVERSION_FACTOR] = 100; // sample_to(10, 1000, seed);
 
-    double chance_black_swan_is_catastrophic = sample_beta(3, 100, seed);
-    double chance_we_can_avert_or_mitigate_catastrophic_risk = sample_beta(2, 100, seed);
+    inputs[COST_OF_SENTINEL_PER_YEAR] = sample_to(150 * THOUSAND,  500 * THOUSAND, seed);
+}
+
+static double evaluate_sentinel_bps_per_million(double* inputs)
+{
+    double black_swans_per_decade = inputs[BLACK_SWANS_PER_DECADE];
+    double chance_we_can_identify_black_swan_a_week_to_two_months_beforehand = inputs[CHANCE_WE_CAN_IDENTIFY_BLACK_SWAN];
+
+    double chance_black_swan_is_existential = inputs[CHANCE_BLACK_SWAN_IS_EXISTENTIAL];
+    double chance_we_can_avert_or_mitigate_existential_risk = inputs[CHANCE_WE_CAN_AVERT_OR_MITIGATE_EXISTENTIAL_RISK];
 
-    double catastrophic_to_existential_conversion_factor = 100; // sample_to(10, 1000, seed);
+    double chance_black_swan_is_catastrophic = inputs[CHANCE_BLACK_SWAN_IS_CATASTROPHIC];
+    double chance_we_can_avert_or_mitigate_catastrophic_risk = inputs[CHANCE_WE_CAN_AVERT_OR_MITIGATE_CATASTROPHIC_RISK];
+
+    double catastrophic_to_existential_conversion_factor = inputs[CATASTROPHIC_TO_EXISTENTIAL_CONVERSION_FACTOR];
 
     double existential_risk_equivalents_averted_per_black_swan = (chance_black_swan_is_existential * chance_we_can_avert_or_mitigate_existential_risk) + (chance_black_swan_is_catastrophic * chance_we_can_avert_or_mitigate_catastrophic_risk / catastrophic_to_existential_conversion_factor);
 
-    double cost_of_sentinel_per_year = sample_to(150 * THOUSAND,  500 * THOUSAND, seed);
+    double cost_of_sentinel_per_year = inputs[COST_OF_SENTINEL_PER_YEAR];
     double cost_of_sentinel_per_decade = cost_of_sentinel_per_year * 10;
 
-    /* double probability_reduction_in_existential_risk_per_dollar = black_swans_per_decade * 
-        chance_we_can_identify_black_swan_a_week_to_two_months_beforehand * 
+    /* double probability_reduction_in_existential_risk_per_dollar = black_swans_per_decade *
+        chance_we_can_identify_black_swan_a_week_to_two_months_beforehand *
         existential_risk_equivalents_averted_per_black_swan /
         cost_of_sentinel_per_decade;
     */
-    double basis_point_reduction_in_existential_risk_per_million_dollars = black_swans_per_decade * 
-        chance_we_can_identify_black_swan_a_week_to_two_months_beforehand * 
+    double basis_point_reduction_in_existential_risk_per_million_dollars = black_swans_per_decade *
+        chance_we_can_identify_black_swan_a_week_to_two_months_beforehand *
         (100.0 * 100.0 * existential_risk_equivalents_averted_per_black_swan) /
         (cost_of_sentinel_per_decade / MILLION);
 
     return basis_point_reduction_in_existential_risk_per_million_dollars;
 }
+
+double sample_cost_effectiveness_sentinel_bps_per_million(uint64_t * seed){
+    double inputs[N_SENTINEL_INPUTS];
+    sample_sentinel_inputs(inputs, seed);
+    return evaluate_sentinel_bps_per_million(inputs);
+}
+
+/* Analytic means of the inputs, for control variates */
+static double sentinel_input_means[N_SENTINEL_INPUTS];
+
+static double beta_mean(double a, double b)
+{
+    return a / (a + b);
+}
+
+static double to_mean(double low, double high)
+{
+    // The mean of a lognormal is exp(logmean + logstd^2 / 2)
+    lognormal_params params = convert_ci_to_lognormal_params((ci) { .low = low, .high = high });
+    return exp(params.logmean + params.logstd * params.logstd / 2);
+}
+
+__attribute__((constructor)) static void compute_sentinel_input_means(void)
+{
+    sentinel_input_means[TOTAL_AMOUNT_XRISK] = beta_mean(2, 20);
+    sentinel_input_means[BLACK_SWANS_PER_DECADE] = to_mean(1, 7);
+    sentinel_input_means[CHANCE_WE_CAN_IDENTIFY_BLACK_SWAN] = beta_mean(5, 10);
+    sentinel_input_means[CHANCE_BLACK_SWAN_IS_EXISTENTIAL] = beta_mean(1, 100);
+    sentinel_input_means[CHANCE_WE_CAN_AVERT_OR_MITIGATE_EXISTENTIAL_RISK] = beta_mean(5, 1 * THOUSAND);
+    sentinel_input_means[CHANCE_BLACK_SWAN_IS_CATASTROPHIC] = beta_mean(3, 100);
+    sentinel_input_means[CHANCE_WE_CAN_AVERT_OR_MITIGATE_CATASTROPHIC_RISK] = beta_mean(2, 100);
+    sentinel_input_means[CATASTROPHIC_TO_EXISTENTIAL_CONVERSION_FACTOR] = NAN; // constant
+    sentinel_input_means[COST_OF_SENTINEL_PER_YEAR] = to_mean(150 * THOUSAND, 500 * THOUSAND);
+}
+
+const Sensitivity_model sentinel_sensitivity_model = {
+    .n_inputs = N_SENTINEL_INPUTS,
+    .input_names = sentinel_input_names,
+    .sample_inputs = sample_sentinel_inputs,
+    .evaluate = evaluate_sentinel_bps_per_million,
+    .input_means = sentinel_input_means,
+};
+
+/*
+The same model, as an expression tree, so that the two lognormals fuse into one and constants fold.
+Built before main and freed after it returns, so that samplers on any thread can read it without a lock or a check
+*/
+static Node* sentinel_fused = NULL;
+
+__attribute__((constructor)) static void build_sentinel_fused(void)
+{
+    // total_amount_xrisk isn't used by the model, so it's not drawn here
+    Node* black_swans_per_decade = node_to(1, 7);
+    Node* chance_we_can_identify_black_swan_a_week_to_two_months_beforehand = node_beta(5, 10);
+
+    Node* chance_black_swan_is_existential = node_beta(1, 100);
+    Node* chance_we_can_avert_or_mitigate_existential_risk = node_beta(5, 1 * THOUSAND);
+
+    Node* chance_black_swan_is_catastrophic = node_beta(3, 100);
+    Node* chance_we_can_avert_or_mitigate_catastrophic_risk = node_beta(2, 100);
+
+    Node* catastrophic_to_existential_conversion_factor = node_constant(100); // node_to(10, 1000);
+
+    Node* existential_risk_equivalents_averted_per_black_swan = node_sum(
+        node_product(chance_black_swan_is_existential, chance_we_can_avert_or_mitigate_existential_risk),
+        node_quotient(node_product(chance_black_swan_is_catastrophic, chance_we_can_avert_or_mitigate_catastrophic_risk), catastrophic_to_existential_conversion_factor));
+
+    Node* cost_of_sentinel_per_year = node_to(150 * THOUSAND, 500 * THOUSAND);
+    Node* cost_of_sentinel_per_decade = node_product(cost_of_sentinel_per_year, node_constant(10));
+
+    Node* basis_point_reduction_in_existential_risk_per_million_dollars = node_quotient(
+        node_product(
+            node_product(black_swans_per_decade, chance_we_can_identify_black_swan_a_week_to_two_months_beforehand),
+            node_product(node_constant(100.0 * 100.0), existential_risk_equivalents_averted_per_black_swan)),
+        node_quotient(cost_of_sentinel_per_decade, node_constant(MILLION)));
+
+    sentinel_fused = node_simplify(basis_point_reduction_in_existential_risk_per_million_dollars);
+    node_free(basis_point_reduction_in_existential_risk_per_million_dollars);
+}
+
+__attribute__((destructor)) static void free_sentinel_fused(void)
+{
+    node_free(sentinel_fused);
+    sentinel_fused = NULL;
+}
+
+double sample_cost_effectiveness_sentinel_bps_per_million_fused(uint64_t* seed)
+{
+    // Same distribution as sample_cost_effectiveness_sentinel_bps_per_million, with one lognormal draw instead of two
+    return node_sample(sentinel_fused, seed);
+}
+
+/* The same model, in columnar form: each input is drawn as a batch, then combined in one vectorizable loop */
+void sample_cost_effectiveness_sentinel_bps_per_million_batch(double* results, int n, uint64_t* seed)
+{
+    // n <= SAMPLER_BATCH_SIZE, so that all the inputs stay in cache
+    // total_amount_xrisk isn't used by the model, so it's not drawn here
+    double black_swans_per_decade[SAMPLER_BATCH_SIZE];
+    double chance_we_can_identify_black_swan_a_week_to_two_months_beforehand[SAMPLER_BATCH_SIZE];
+    double chance_black_swan_is_existential[SAMPLER_BATCH_SIZE];
+    double chance_we_can_avert_or_mitigate_existential_risk[SAMPLER_BATCH_SIZE];
+    double chance_black_swan_is_catastrophic[SAMPLER_BATCH_SIZE];
+    double chance_we_can_avert_or_mitigate_catastrophic_risk[SAMPLER_BATCH_SIZE];
+    double cost_of_sentinel_per_year[SAMPLER_BATCH_SIZE];
+
+    sample_to_batch(1, 7, black_swans_per_decade, n, seed);
+    sample_beta_batch(5, 10, chance_we_can_identify_black_swan_a_week_to_two_months_beforehand, n, seed);
+    sample_beta_batch(1, 100, chance_black_swan_is_existential, n, seed);
+    sample_beta_batch(5, 1 * THOUSAND, chance_we_can_avert_or_mitigate_existential_risk, n, seed);
+    sample_beta_batch(3, 100, chance_black_swan_is_catastrophic, n, seed);
+    sample_beta_batch(2, 100, chance_we_can_avert_or_mitigate_catastrophic_risk, n, seed);
+    sample_to_batch(150 * THOUSAND, 500 * THOUSAND, cost_of_sentinel_per_year, n, seed);
+
+    double catastrophic_to_existential_conversion_factor = 100;
+
+    #pragma omp simd
+    for (int i = 0; i < n; i++) {
+        double existential_risk_equivalents_averted_per_black_swan = (chance_black_swan_is_existential[i] * chance_we_can_avert_or_mitigate_existential_risk[i]) + (chance_black_swan_is_catastrophic[i] * chance_we_can_avert_or_mitigate_catastrophic_risk[i] / catastrophic_to_existential_conversion_factor);
+        double cost_of_sentinel_per_decade = cost_of_sentinel_per_year[i] * 10;
+        results[i] = black_swans_per_decade[i] *
+            chance_we_can_identify_black_swan_a_week_to_two_months_beforehand[i] *
+            (100.0 * 100.0 * existential_risk_equivalents_averted_per_black_swan) /
+            (cost_of_sentinel_per_decade / MILLION);
+    }
+}
@@ -1,8 +1,28 @@
 #include "squiggle_c/squiggle.h"
 #include "squiggle_c/squiggle_more.h"
+#include "sensitivity.h"
+#include "algebra.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <float.h>
 #include <math.h>
 
 double sample_cost_effectiveness_sentinel_bps_per_million(uint64_t * seed);
+
+/* The model's inputs, drawn separately from its evaluation, for sensitivity analysis and parameter sweeps */
+enum sentinel_inputs {
+    TOTAL_AMOUNT_XRISK,
+    BLACK_SWANS_PER_DECADE,
+    CHANCE_WE_CAN_IDENTIFY_BLACK_SWAN,
+    CHANCE_BLACK_SWAN_IS_EXISTENTIAL,
+    CHANCE_WE_CAN_AVERT_OR_MITIGATE_EXISTENTIAL_RISK,
+    CHANCE_BLACK_SWAN_IS_CATASTROPHIC,
+    CHANCE_WE_CAN_AVERT_OR_MITIGATE_CATASTROPHIC_RISK,
+    CATASTROPHIC_TO_EXISTENTIAL_CONVERSION_FACTOR,
+    COST_OF_SENTINEL_PER_YEAR,
+    N_SENTINEL_INPUTS
+};
+
+extern const Sensitivity_model sentinel_sensitivity_model; // same model, split into inputs and evaluation
+double sample_cost_effectiveness_sentinel_bps_per_million_fused(uint64_t* seed); // same distribution, fewer draws
+void sample_cost_effectiveness_sentinel_bps_per_million_batch(double* results, int n, uint64_t* seed); // columnar, n <= SAMPLER_BATCH_SIZE
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "reporter.h"
+
+#define REPORTER_POLL_NANOSECONDS 1000000 // 1ms; iterations take seconds, so polling is cheap
+
+static void reporter_sleep(void)
+{
+    struct timespec interval = { .tv_sec = 0, .tv_nsec = REPORTER_POLL_NANOSECONDS };
+    nanosleep(&interval, NULL);
+}
+
+static void* reporter_loop(void* arg)
+{
+    Reporter* reporter = (Reporter*)arg;
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&reporter->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&reporter->head, memory_order_acquire);
+        if (tail == head) {
+            // Check stopping before head again, so that a slot published just before stopping isn't lost
+            if (atomic_load_explicit(&reporter->stopping, memory_order_acquire) && tail == atomic_load_explicit(&reporter->head, memory_order_acquire)) {
+                break;
+            }
+            reporter_sleep();
+            continue;
+        }
+        reporter->consume(reporter->slots[tail % (uint64_t)reporter->n_slots], reporter->context);
+        atomic_store_explicit(&reporter->tail, tail + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+int reporter_start(Reporter* reporter, void** slots, int n_slots, void (*consume)(void* slot, void* context), void* context)
+{
+    reporter->slots = slots;
+    reporter->n_slots = n_slots;
+    atomic_init(&reporter->head, 0);
+    atomic_init(&reporter->tail, 0);
+    atomic_init(&reporter->stopping, 0);
+    reporter->consume = consume;
+    reporter->context = context;
+    return pthread_create(&reporter->thread, NULL, reporter_loop, reporter);
+}
+
+void* reporter_acquire(Reporter* reporter)
+{
+    uint64_t head = atomic_load_explicit(&reporter->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&reporter->tail, memory_order_acquire) >= (uint64_t)reporter->n_slots) {
+        reporter_sleep();
+    }
+    return reporter->slots[head % (uint64_t)reporter->n_slots];
+}
+
+void reporter_publish(Reporter* reporter)
+{
+    uint64_t head = atomic_load_explicit(&reporter->head, memory_order_relaxed);
+    atomic_store_explicit(&reporter->head, head + 1, memory_order_release);
+}
+
+void reporter_stop(Reporter* reporter)
+{
+    atomic_store_explicit(&reporter->stopping, 1, memory_order_release);
+    pthread_join(reporter->thread, NULL);
+}
+
+FILE* status_file_begin(const char* path)
+{
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    return fopen(tmp_path, "w");
+}
+
+int status_file_commit(FILE* file, const char* path)
+{
+    // rename is atomic within a filesystem, so readers see either the old or the new file, never half of one
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (fclose(file) != 0) return 1;
+    return rename(tmp_path, path);
+}
+
+void status_file_write_string(FILE* file, const char* string)
+{
+    fputc('"', file);
+    for (const unsigned char* c = (const unsigned char*)string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+            fputc(*c, file);
+        } else if (*c < 0x20) {
+            fprintf(file, "\\u%04x", *c); // control characters aren't allowed in JSON strings
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
@@ -0,0 +1,37 @@
+#ifndef FINISTERRAE_REPORTER
+#define FINISTERRAE_REPORTER
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Reporting off the sampling thread: a single producer, single consumer queue of snapshots, consumed by a reporter thread */
+
+/*
+The slots are allocated by the caller, and filled in place by the producer.
+head and tail only ever grow; slot k lives in slots[k % n_slots].
+The producer only waits if all slots are still waiting to be consumed.
+*/
+typedef struct _Reporter {
+    void** slots;
+    int n_slots;
+    _Atomic uint64_t head; // slots published, written only by the producer
+    _Atomic uint64_t tail; // slots consumed, written only by the consumer
+    _Atomic int stopping;
+    void (*consume)(void* slot, void* context);
+    void* context;
+    pthread_t thread;
+} Reporter;
+
+int reporter_start(Reporter* reporter, void** slots, int n_slots, void (*consume)(void* slot, void* context), void* context);
+void* reporter_acquire(Reporter* reporter); // the next slot to fill
+void reporter_publish(Reporter* reporter); // hands the filled slot to the reporter thread
+void reporter_stop(Reporter* reporter); // consumes what is left, and joins the reporter thread
+
+/* Status file, replaced atomically: written to path.tmp, then renamed over path */
+FILE* status_file_begin(const char* path);
+int status_file_commit(FILE* file, const char* path);
+void status_file_write_string(FILE* file, const char* string); // as a JSON string, quoted and escaped
+
+#endif
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "result_cache.h"
+
+#define RESULT_CACHE_MAGIC 0x46494e4943414348ULL // "FINICACH"
+#define RESULT_CACHE_FORMAT_VERSION 1
+
+uint64_t result_cache_key(const char* description)
+{
+    // FNV-1a <http://www.isthe.com/chongo/tech/comp/fnv/>; not cryptographic, but the description is checked on load anyway
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char* c = description; *c != '\0'; c++) {
+        hash ^= (uint64_t)(unsigned char)*c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void result_cache_path(const char* directory, const char* description, char* path, size_t path_length)
+{
+    snprintf(path, path_length, "%s/%016lx.bin", directory, result_cache_key(description));
+}
+
+int result_cache_load(const char* directory, const char* description, Cached_result* result, uint64_t* bins)
+{
+    char path[4096];
+    result_cache_path(directory, description, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return 1;
+    uint64_t magic;
+    int version;
+    int ok = fread(&magic, sizeof(magic), 1, file) == 1 && magic == RESULT_CACHE_MAGIC
+        && fread(&version, sizeof(version), 1, file) == 1 && version == RESULT_CACHE_FORMAT_VERSION
+        && fread(result, sizeof(Cached_result), 1, file) == 1
+        && strncmp(result->description, description, RESULT_CACHE_DESCRIPTION_LENGTH) == 0
+        && result->n_bins >= 0 && result->n_threads > 0 && result->n_threads <= RESULT_CACHE_MAX_THREADS
+        && fread(bins, sizeof(uint64_t), (size_t)result->n_bins, file) == (size_t)result->n_bins;
+    fclose(file);
+    return !ok;
+}
+
+int result_cache_save(const char* directory, Cached_result* result, uint64_t* bins)
+{
+    // Written next to its final name and renamed over it, so that a crash never leaves a truncated entry behind
+    char path[4096];
+    char tmp_path[4200];
+    result_cache_path(directory, result->description, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "wb");
+    if (file == NULL) return 1;
+    uint64_t magic = RESULT_CACHE_MAGIC;
+    int version = RESULT_CACHE_FORMAT_VERSION;
+    int ok = fwrite(&magic, sizeof(magic), 1, file) == 1
+        && fwrite(&version, sizeof(version), 1, file) == 1
+        && fwrite(result, sizeof(Cached_result), 1, file) == 1
+        && fwrite(bins, sizeof(uint64_t), (size_t)result->n_bins, file) == (size_t)result->n_bins;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) return 1;
+    return rename(tmp_path, path);
+}
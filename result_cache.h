@@ -0,0 +1,34 @@
+#ifndef FINISTERRAE_RESULT_CACHE
+#define FINISTERRAE_RESULT_CACHE
+
+#include <stdint.h>
+
+/* Local result store, keyed by a hash of everything that determines a run's samples but their number */
+
+#define RESULT_CACHE_DESCRIPTION_LENGTH 1024
+#define RESULT_CACHE_MAX_THREADS 1024
+
+/*
+The description is a canonical string of (model code, parameters, histogram, RNG scheme, seed);
+its hash names the file, and the full string is stored too, so that collisions are caught on load.
+The seeds are the RNG stream position at the end of the run, one per thread, so that a longer run can continue from there.
+*/
+typedef struct _Cached_result {
+    char description[RESULT_CACHE_DESCRIPTION_LENGTH];
+    uint64_t n_samples;
+    double mean;
+    double m2; // sum of squared deviations from the mean
+    double min;
+    double max;
+    uint64_t below; // histogram underflow and overflow
+    uint64_t above;
+    int n_bins;
+    int n_threads;
+    uint64_t seeds[RESULT_CACHE_MAX_THREADS];
+} Cached_result;
+
+uint64_t result_cache_key(const char* description);
+int result_cache_load(const char* directory, const char* description, Cached_result* result, uint64_t* bins); // 0 if found
+int result_cache_save(const char* directory, Cached_result* result, uint64_t* bins);
+
+#endif
@@ -3,8 +3,20 @@
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
 
+#include "convergence.h"
+#include "exact_sum.h"
+#include "histogram.h"
 #include "model.h"
+#include "reporter.h"
+#include "service.h"
+#include "sensitivity.h"
+#include "shard.h"
+#include "tail.h"
+#include "variance_reduction.h"
+#include "work_pool.h"
 #include "squiggle_c/squiggle.h"
 #include "squiggle_c/squiggle_more.h"
 
@@ -14,46 +26,90 @@
 #define IF_MPI(x)
 #define IF_NO_MPI(x) x
 #define MPI_Status int
+#ifndef N_SAMPLES_PER_PROCESS
 #define N_SAMPLES_PER_PROCESS MILLION
+#endif
 #else
 #include "mpi.h" /* N: why is this "mpi.h" and not <mpi.h> ??? */
 #define IF_MPI(x) x
 #define IF_NO_MPI(x)
+#ifndef N_SAMPLES_PER_PROCESS
 #define N_SAMPLES_PER_PROCESS BILLION
+#endif
 #define uint64_t u_int64_t
 #endif
 
+/* Total samples to draw. Overridable with -D, e.g., for the short pgo training run in the makefile */
+#ifndef N_SAMPLES_TOTAL
+#define N_SAMPLES_TOTAL TRILLION
+#endif
+
+#ifndef MODEL_CODE_HASH
+#define MODEL_CODE_HASH "unknown" // the makefile passes a checksum of the model's sources
+#endif
+
 /* Collect outliers manually? */
 #define COLLECT_OUTLIERS 0
 
-/* External interface struct */
+/* External interface structs */
+// A variant is one of several models, or one model at one of several parameter points, sampled together
+typedef struct _Finisterrae_variant {
+    const char* name;
+    double (*sampler)(uint64_t* seed);
+    // Alternatively, a model split into inputs and evaluation, with one of its inputs fixed
+    const Sensitivity_model* model;
+    int fixed_input;
+    double fixed_value;
+} Finisterrae_variant;
+
+// How samples are spread over threads
+typedef enum _Finisterrae_backend {
+    BACKEND_OPENMP = 0, // omp parallel for, one phase after another
+    BACKEND_WORK_STEALING, // sampling on persistent workers stealing fixed-size chunks, see work_pool.h; the stats phases stay on OpenMP. Same samples either way
+} Finisterrae_backend;
+
 typedef struct _Finisterrae_params {
     const double (*sampler)(uint64_t* seed);
-    const uint64_t n_samples_per_process;
-    const uint64_t n_samples_total;
+    // Optional: columnar version of the model, which fills up to SAMPLER_BATCH_SIZE samples at a time. Used instead of sampler if set.
+    // It only draws the model itself, so it can't be combined with variants or variance reduction
+    void (*batch_sampler)(double* results, int n, uint64_t* seed);
+    const uint64_t n_samples_per_process; // with a memory budget, an upper bound on the samples kept in memory at once
+    const uint64_t n_samples_total; // over all processes; the last iteration draws fewer samples if need be, to hit it exactly
     const double histogram_min;
     const double histogram_sup;
     const double histogram_bin_width;
     const int histogram_n_bins;
     const int print_every_n_iters;
+    // Optional: Sobol indices of the model's inputs, from extra pick-freeze samples on a separate RNG stream
+    const Sensitivity_model* sensitivity_model;
+    const uint64_t sensitivity_n_samples_per_process; // per iteration; each costs n_inputs + 2 model evaluations
+    // Optional: variants drawn in the same pass, each with its own stats. Used instead of sampler if n_variants > 0
+    const Finisterrae_variant* variants;
+    const int n_variants;
+    const int common_random_numbers; // if 1, all variants see the same random numbers for each sample
+    // Optional: lower variance estimators of the mean, reported next to the naive one. Can't be combined with variants or batch_sampler
+    const int antithetic; // if 1, draw samples in antithetic pairs. Needs a build with reflected uniforms: make build-antithetic
+    const Sensitivity_model* control_variate_model; // if set, draw samples from this model instead of sampler, and use its inputs with known means as control variates
+    // Optional: memory per process, in bytes. If 0, taken from SLURM's --mem or --mem-per-cpu when running under it.
+    // The chunk of samples per iteration is then the largest that fits, up to n_samples_per_process
+    const uint64_t memory_budget_per_process;
+    // Optional: reporting, which happens on its own thread on process 0
+    const char* status_file; // if set, a JSON summary replaced atomically after every iteration, for live monitoring
+    const double print_min_seconds; // if > 0, skip console reports that come sooner than this after the last one
+    // Optional: execution backend. Work stealing is only used for plain samplers, without batch_sampler, variants or variance reduction
+    const Finisterrae_backend backend;
+    // Optional: if 1, ranks on the same node merge their stats in shared memory, and only one rank per node sends them to rank 0.
+    // For several ranks per node, e.g., one per socket or NUMA domain
+    const int node_aggregation;
+    // Optional: shard mode, for runs split into independent jobs, e.g., the tasks of a SLURM job array (see launch_shards.sh).
+    // If shard_count > 0, this run draws its 1 / shard_count of n_samples_total from RNG substreams disjoint from every other
+    // shard's (see shard.h), and process 0 writes its mergeable stats to shard_file at the end. ./samples --merge combines them
+    const uint64_t shard_index;
+    const uint64_t shard_count;
+    const char* shard_file;
 } Finisterrae_params;
 
 /* Internal interface structs */
-#define CACHE_LINE_SIZE 64
-typedef struct _seed_cache_box {
-    uint64_t seed;
-    char padding[CACHE_LINE_SIZE - sizeof(uint64_t)];
-    // Cache line size is 64 *bytes*, uint64_t is 64 *bits* (8 bytes). Different units!
-} seed_cache_box;
-
-typedef struct _Histogram {
-    double min;
-    double sup;
-    double bin_width;
-    int n_bins;
-    uint64_t* bins;
-} Histogram;
-
 typedef struct _Outliers {
     double* os;
     int n;
@@ -66,35 +122,178 @@ typedef struct _Summary_stats {
     double max;
     double mean;
     double variance;
+    // Third and fourth central moments, divided by n like the variance, for skewness and kurtosis
+    double third_moment;
+    double fourth_moment;
+    // The moments above are computed from these: exact sums of (x - shift)^k, k = 1..4, where the shift is the same for
+    // every process and iteration. Being exact, their merges don't depend on the order of threads, processes or nodes.
+    // So are the sums of the sensitivity analysis and of the differences below. The tail keeps a set of samples, whatever
+    // the order; the variance reduction sums and the convergence batches don't depend on the threads, but do on node aggregation
+    double shift;
+    Exact_sum power_sums[4];
     Histogram histogram;
     Outliers outliers;
+    Sensitivity_stats sensitivity;
+    Tail_stats tail;
+    Variance_reduction_stats variance_reduction;
+    // Variants only: exact sums of (d - difference_shift)^k, k = 1, 2, where d is this variant minus the first one, sample by sample,
+    // and difference_shift the difference of their shifts, so that these merge exactly too
+    uint64_t n_differences;
+    double difference_shift;
+    Exact_sum difference_sums[2];
 } Summary_stats;
 
+/*
+Reports: process 0 gathers each iteration's stats straight into a slot of the reporter's queue,
+and the reporter thread merges and prints them while the next iteration samples
+*/
+#define N_REPORT_SLOTS 4
+
+// Histograms travel serialized (see histogram.h), and their size varies from one iteration to the next
+typedef struct _Byte_buffer {
+    unsigned char* bytes;
+    size_t size;
+    size_t capacity;
+} Byte_buffer;
+
+typedef struct _Report {
+    uint64_t iteration;
+    double peak_rss; // max over processes, in GB
+    int n_sources; // processes, or nodes with node aggregation
+    Summary_stats* process_stats; // [variant][source]; their histogram fields are stale, the histograms are the following
+    Byte_buffer process_histograms;
+    int* histogram_sizes; // [variant][source], in bytes
+    int* histogram_offsets; // [variant][source], into process_histograms
+    Convergence* process_convergences; // [source]
+} Report;
+
+typedef struct _Report_context {
+    const Finisterrae_params* finisterrae;
+    const Finisterrae_variant* variants;
+    int n_variants;
+    int n_sources; // of the latest report
+    Summary_stats* aggregated_stats; // only touched by the reporter thread until it stops
+    Convergence* process_convergences; // latest
+    double last_print_time;
+} Report_context;
+
+/*
+Every backend draws samples in chunks of SAMPLING_CHUNK_SIZE. Chunks are numbered across iterations, and chunk c starts
+c * CHUNK_STRIDE draws into its process's substream (see shard.h), so chunks that draw at most CHUNK_STRIDE numbers never
+share a state. And samples don't depend on which thread or worker ran which chunk, nor on their number, nor on the backend.
+The pick-freeze samples of the sensitivity analysis go in smaller chunks, as there are fewer of them, in their own substream
+*/
+#define SAMPLING_CHUNK_SIZE 16384
+#define SENSITIVITY_CHUNK_SIZE 64
+#define CHUNK_STRIDE ((uint64_t)1 << 32) // draws; 2^18 per sample of a sampling chunk, 2^26 per pick-freeze sample
+
+typedef struct _Sampling_task {
+    double (*sampler)(uint64_t* seed);
+    double* xs;
+    const Xorshift_jumps* jumps;
+    uint64_t stream_seed; // start of the process's substream
+    uint64_t first_chunk; // of this iteration, counted from the start of the substream
+} Sampling_task;
+
 /* Helpers */
-double combine_variances(Summary_stats* x, Summary_stats* y)
+static uint64_t chunk_seed(const Sampling_task* task, int64_t chunk)
+{
+    return xorshift_jump(task->jumps, task->stream_seed, (task->first_chunk + (uint64_t)chunk) * CHUNK_STRIDE);
+}
+
+static void sample_chunk(int64_t begin, int64_t end, int64_t chunk, void* context)
 {
-    double n = (double)(x->n_samples + y->n_samples);
-    double term1 = (x->variance * ((double)x->n_samples / n)) + (y->variance * ((double)y->n_samples / n));
-    double term2 = (((double)x->n_samples / n) * ((double)y->n_samples / n)) * (x->mean - y->mean) * (x->mean - y->mean);
-    double result = term1 + term2;
+    Sampling_task* task = (Sampling_task*)context;
+    uint64_t seed = chunk_seed(task, chunk);
+    for (int64_t j = begin; j < end; j++) {
+        task->xs[j] = task->sampler(&seed);
+    }
+}
+
+static double sample_variant(const Finisterrae_variant* variant, double* inputs, int inputs_drawn, uint64_t* seed)
+{
+    if (variant->model == NULL) {
+        return variant->sampler(seed);
+    }
+    if (!inputs_drawn) {
+        variant->model->sample_inputs(inputs, seed);
+    }
+    double drawn_value = inputs[variant->fixed_input];
+    inputs[variant->fixed_input] = variant->fixed_value;
+    double result = variant->model->evaluate(inputs);
+    inputs[variant->fixed_input] = drawn_value;
     return result;
-    // https://math.stackexchange.com/questions/2971315/how-do-i-combine-standard-deviations-of-two-groups
-    // but use the standard deviation of the samples, not the estimate of the standard deviation of the underlying distribution
 }
 
+/*
+Shift of each variant's shifted sums: its power sums, and the sensitivity and variance reduction sums.
+From a pilot run on the pilot segment of the RNG (see shard.h), which every process and shard draws the same before sampling,
+so that all their sums are around the same point and merge exactly
+*/
+#define PILOT_SAMPLES 65536
+
+static double pilot_mean(const Finisterrae_params* finisterrae, const Finisterrae_variant* variant, int v, int n_variants)
+{
+    uint64_t seed;
+    uint64_t shard_count = finisterrae->shard_count > 0 ? finisterrae->shard_count : 1; // runs without shards are shard 0 of 1
+    shard_stream_seeds(shard_count, shard_count, (uint64_t)n_variants, (uint64_t)v, 1, &seed);
+    double* xs = (double*)malloc(PILOT_SAMPLES * sizeof(double));
+    for (int j = 0; j < PILOT_SAMPLES; j += SAMPLER_BATCH_SIZE) {
+        int batch_size = (PILOT_SAMPLES - j) < SAMPLER_BATCH_SIZE ? (PILOT_SAMPLES - j) : SAMPLER_BATCH_SIZE;
+        if (finisterrae->batch_sampler != NULL) {
+            finisterrae->batch_sampler(xs + j, batch_size, &seed);
+            continue;
+        }
+        for (int k = j; k < j + batch_size; k++) {
+            double inputs[MAX_SENSITIVITY_INPUTS];
+            xs[k] = sample_variant(variant, inputs, 0, &seed);
+        }
+    }
+    double mean = array_mean(xs, PILOT_SAMPLES);
+    free(xs);
+    return isfinite(mean) ? mean : 0.0;
+}
+
+static void combine_differences(Summary_stats* accumulator, Summary_stats* new)
+{
+    if (new->n_differences == 0) return;
+    if (accumulator->n_differences == 0) accumulator->difference_shift = new->difference_shift;
+    accumulator->n_differences += new->n_differences;
+    exact_sum_merge(&accumulator->difference_sums[0], &new->difference_sums[0]);
+    exact_sum_merge(&accumulator->difference_sums[1], &new->difference_sums[1]);
+}
+
+static void moments_from_power_sums(Summary_stats* stats)
+{
+    // Central moments from the raw moments of x - shift. As the shift is close to the mean, m1 is small, and nothing cancels much
+    double n = (double)stats->n_samples;
+    double m1 = exact_sum_value(&stats->power_sums[0]) / n;
+    double m2 = exact_sum_value(&stats->power_sums[1]) / n;
+    double m3 = exact_sum_value(&stats->power_sums[2]) / n;
+    double m4 = exact_sum_value(&stats->power_sums[3]) / n;
+    double m1_2 = m1 * m1;
+    stats->mean = stats->shift + m1;
+    stats->variance = m2 - m1_2;
+    stats->third_moment = m3 - 3.0 * m1 * m2 + 2.0 * m1_2 * m1;
+    stats->fourth_moment = m4 - 4.0 * m1 * m3 + 6.0 * m1_2 * m2 - 3.0 * m1_2 * m1_2;
+}
+
+// Merges everything but the histograms, which are merged from their serialized form
 void reduce_chunk_stats(Summary_stats* accumulator, Summary_stats* new, int n_chunks)
 {
-    double sum_weighted_means = accumulator->mean * accumulator->n_samples;
     for (int i = 0; i < n_chunks; i++) {
-        sum_weighted_means += new[i].mean* new[i].n_samples;
+        if (new[i].n_samples == 0) continue;
+        if (accumulator->n_samples == 0) accumulator->shift = new[i].shift;
         accumulator->n_samples += new[i].n_samples;
-        accumulator->mean = sum_weighted_means / accumulator->n_samples; // need this for the variance calculations
-        accumulator->variance = combine_variances(accumulator, new + i);
+        for (int k = 0; k < 4; k++) {
+            exact_sum_merge(&accumulator->power_sums[k], &new[i].power_sums[k]);
+        }
         if (accumulator->min > new[i].min) accumulator->min = new[i].min;
         if (accumulator->max < new[i].max) accumulator->max = new[i].max;
-        for (int j = 0; j < accumulator->histogram.n_bins; j++) {
-            accumulator->histogram.bins[j] += new[i].histogram.bins[j];
-        }
+        sensitivity_merge(&accumulator->sensitivity, &new[i].sensitivity);
+        tail_merge(&accumulator->tail, &new[i].tail);
+        variance_reduction_merge(&accumulator->variance_reduction, &new[i].variance_reduction);
+        combine_differences(accumulator, new + i);
         if (COLLECT_OUTLIERS) {
             if (accumulator->outliers.n + new[i].outliers.n >= accumulator->outliers.capacity) {
                 int new_capacity = accumulator->outliers.capacity * 2;
@@ -112,14 +311,230 @@ void reduce_chunk_stats(Summary_stats* accumulator, Summary_stats* new, int n_ch
             }
         }
     }
-    accumulator->mean = sum_weighted_means / accumulator->n_samples;
+    if (accumulator->n_samples > 0) moments_from_power_sums(accumulator);
+}
+
+// Empty until the first report is merged in, so that the aggregate only depends on the samples it was sent
+static Summary_stats aggregate_stats_init(const Finisterrae_params* finisterrae, int v)
+{
+    double* os = NULL;
+    if (COLLECT_OUTLIERS) {
+        os = (double*)malloc((size_t)100 * sizeof(double));
+    }
+    return (Summary_stats) {
+        .n_samples = 0,
+        .min = DBL_MAX,
+        .max = -DBL_MAX,
+        .mean = 0.0,
+        .variance = 0.0,
+        .power_sums = { exact_sum_init(), exact_sum_init(), exact_sum_init(), exact_sum_init() },
+        .histogram = histogram_init(finisterrae->histogram_min, finisterrae->histogram_sup, finisterrae->histogram_bin_width, finisterrae->histogram_n_bins),
+        .outliers = (Outliers) { .os = os, .n = 0, .capacity = 100 },
+        .sensitivity = sensitivity_stats_init(v == 0 ? finisterrae->sensitivity_model : NULL, 0.0),
+        .tail = tail_stats_init(),
+        .variance_reduction = variance_reduction_stats_init(finisterrae->control_variate_model, finisterrae->antithetic ? 2 : 1, 0.0),
+    };
+}
+
+/* Memory budget */
+#define MEGABYTE ((uint64_t)1024 * 1024)
+#define MEMORY_BUDGET_FRACTION 0.8 // leave room for the binary, the stacks, MPI's buffers and the allocator's own overhead
+
+static uint64_t memory_budget_from_slurm(void)
+{
+    // SLURM exports --mem as SLURM_MEM_PER_NODE and --mem-per-cpu as SLURM_MEM_PER_CPU, in megabytes
+    char* mem_per_node = getenv("SLURM_MEM_PER_NODE");
+    char* mem_per_cpu = getenv("SLURM_MEM_PER_CPU");
+    if (mem_per_node != NULL) {
+        char* tasks_per_node = getenv("SLURM_NTASKS_PER_NODE");
+        uint64_t n_tasks = tasks_per_node != NULL ? strtoull(tasks_per_node, NULL, 10) : 1;
+        return strtoull(mem_per_node, NULL, 10) * MEGABYTE / (n_tasks > 0 ? n_tasks : 1);
+    }
+    if (mem_per_cpu != NULL) {
+        char* cpus_per_task = getenv("SLURM_CPUS_PER_TASK");
+        uint64_t n_cpus = cpus_per_task != NULL ? strtoull(cpus_per_task, NULL, 10) : 1;
+        return strtoull(mem_per_cpu, NULL, 10) * MEGABYTE * (n_cpus > 0 ? n_cpus : 1);
+    }
+    return 0;
+}
+
+static int64_t chunk_size_for_budget(uint64_t budget, uint64_t fixed_bytes, uint64_t bytes_per_sample, uint64_t max_chunk_size)
+{
+    double available = (double)budget * MEMORY_BUDGET_FRACTION - (double)fixed_bytes;
+    uint64_t chunk_size = available > 0 ? (uint64_t)(available / (double)bytes_per_sample) : 0;
+    chunk_size -= chunk_size % SAMPLER_BATCH_SIZE;
+    if (chunk_size < SAMPLER_BATCH_SIZE) chunk_size = SAMPLER_BATCH_SIZE;
+    return (int64_t)(chunk_size < max_chunk_size ? chunk_size : max_chunk_size);
+}
+
+static double peak_rss_gigabytes(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)usage.ru_maxrss / (double)MEGABYTE; // ru_maxrss is in kilobytes on Linux
+}
+
+/*
+Hot reduction loops, cloned per instruction set if built with -DSQUIGGLE_MULTIVERSION.
+Sums go block by block. Within each block of SUM_BLOCK_SIZE samples, SUM_LANES running sums, one per lane of the widest
+vector register, each take every SUM_LANES-th sample; the block's sums are then added to exact accumulators (exact_sum.h).
+Blocks are fixed by the samples' indices, and lanes don't depend on the instruction set actually used, so neither does
+any rounding; and exact sums don't care which thread got which block. Together: the same samples give the same bits,
+whatever the number of threads, the schedule, or the node. This needs the release build's -ffp-contract=off,
+as fused multiply-adds would round differently on the avx2 and avx512f clones.
+*/
+#define SUM_BLOCK_SIZE 4096
+#define SUM_LANES 8
+
+SQUIGGLE_DISPATCH
+static void reduce_samples_moments(double* xs, int64_t n_samples, double shift, Exact_sum power_sums[4], double* min, double* max)
+{
+    // Raw moments of x - shift, and min and max, in one pass
+    int64_t n_blocks = (n_samples + SUM_BLOCK_SIZE - 1) / SUM_BLOCK_SIZE;
+    double min_local = DBL_MAX;
+    double max_local = -DBL_MAX;
+    #pragma omp parallel
+    {
+        Exact_sum thread_sums[4] = { exact_sum_init(), exact_sum_init(), exact_sum_init(), exact_sum_init() };
+        double thread_min = DBL_MAX;
+        double thread_max = -DBL_MAX;
+        #pragma omp for schedule(static)
+        for (int64_t b = 0; b < n_blocks; b++) {
+            int64_t begin = b * SUM_BLOCK_SIZE;
+            int64_t end = begin + SUM_BLOCK_SIZE < n_samples ? begin + SUM_BLOCK_SIZE : n_samples;
+            double m1[SUM_LANES] = { 0.0 }, m2[SUM_LANES] = { 0.0 }, m3[SUM_LANES] = { 0.0 }, m4[SUM_LANES] = { 0.0 };
+            double lane_min[SUM_LANES], lane_max[SUM_LANES];
+            for (int l = 0; l < SUM_LANES; l++) {
+                lane_min[l] = DBL_MAX;
+                lane_max[l] = -DBL_MAX;
+            }
+            int64_t k = begin;
+            for (; k + SUM_LANES <= end; k += SUM_LANES) {
+                #pragma omp simd
+                for (int l = 0; l < SUM_LANES; l++) {
+                    double x = xs[k + l];
+                    double d = x - shift;
+                    double d2 = d * d;
+                    m1[l] += d;
+                    m2[l] += d2;
+                    m3[l] += d2 * d;
+                    m4[l] += d2 * d2;
+                    lane_min[l] = x < lane_min[l] ? x : lane_min[l];
+                    lane_max[l] = x > lane_max[l] ? x : lane_max[l];
+                }
+            }
+            for (int l = 0; k < end; k++, l++) {
+                double d = xs[k] - shift;
+                double d2 = d * d;
+                m1[l] += d;
+                m2[l] += d2;
+                m3[l] += d2 * d;
+                m4[l] += d2 * d2;
+                lane_min[l] = xs[k] < lane_min[l] ? xs[k] : lane_min[l];
+                lane_max[l] = xs[k] > lane_max[l] ? xs[k] : lane_max[l];
+            }
+            for (int l = 0; l < SUM_LANES; l++) {
+                exact_sum_add(&thread_sums[0], m1[l]);
+                exact_sum_add(&thread_sums[1], m2[l]);
+                exact_sum_add(&thread_sums[2], m3[l]);
+                exact_sum_add(&thread_sums[3], m4[l]);
+                if (thread_min > lane_min[l]) thread_min = lane_min[l];
+                if (thread_max < lane_max[l]) thread_max = lane_max[l];
+            }
+        }
+        #pragma omp critical
+        {
+            for (int i = 0; i < 4; i++) {
+                exact_sum_merge(&power_sums[i], &thread_sums[i]);
+            }
+            if (min_local > thread_min) min_local = thread_min;
+            if (max_local < thread_max) max_local = thread_max;
+        }
+    }
+    *min = min_local;
+    *max = max_local;
+}
+
+static void reduce_samples_tail(double* xs, int64_t n_samples, Tail_stats* tail)
+{
+    // Each thread keeps the largest samples of its part of xs; then they are merged
+    #pragma omp parallel
+    {
+        Tail_stats thread_tail = tail_stats_init();
+        #pragma omp for
+        for (int64_t k = 0; k < n_samples; k++) {
+            tail_add(&thread_tail, xs[k]);
+        }
+        #pragma omp critical
+        tail_merge(tail, &thread_tail);
+    }
+}
+
+SQUIGGLE_DISPATCH
+static void reduce_samples_difference(double* xs, double* ys, int64_t n_samples, double shift, Exact_sum sums[2])
+{
+    // Sums of d - shift and its square, with d = x - y, in the same blocks and lanes as reduce_samples_moments
+    int64_t n_blocks = (n_samples + SUM_BLOCK_SIZE - 1) / SUM_BLOCK_SIZE;
+    #pragma omp parallel
+    {
+        Exact_sum thread_sums[2] = { exact_sum_init(), exact_sum_init() };
+        #pragma omp for schedule(static)
+        for (int64_t b = 0; b < n_blocks; b++) {
+            int64_t begin = b * SUM_BLOCK_SIZE;
+            int64_t end = begin + SUM_BLOCK_SIZE < n_samples ? begin + SUM_BLOCK_SIZE : n_samples;
+            double m1[SUM_LANES] = { 0.0 }, m2[SUM_LANES] = { 0.0 };
+            int64_t k = begin;
+            for (; k + SUM_LANES <= end; k += SUM_LANES) {
+                #pragma omp simd
+                for (int l = 0; l < SUM_LANES; l++) {
+                    double d = xs[k + l] - ys[k + l] - shift;
+                    m1[l] += d;
+                    m2[l] += d * d;
+                }
+            }
+            for (int l = 0; k < end; k++, l++) {
+                double d = xs[k] - ys[k] - shift;
+                m1[l] += d;
+                m2[l] += d * d;
+            }
+            for (int l = 0; l < SUM_LANES; l++) {
+                exact_sum_add(&thread_sums[0], m1[l]);
+                exact_sum_add(&thread_sums[1], m2[l]);
+            }
+        }
+        #pragma omp critical
+        {
+            exact_sum_merge(&sums[0], &thread_sums[0]);
+            exact_sum_merge(&sums[1], &thread_sums[1]);
+        }
+    }
+}
+
+static double skewness(Summary_stats* stats)
+{
+    return stats->variance > 0 ? stats->third_moment / pow(stats->variance, 1.5) : 0.0;
+}
+
+static double excess_kurtosis(Summary_stats* stats)
+{
+    // 0 for a normal; heavy tails make it large, and its growth with n is a sign that the fourth moment doesn't exist
+    return stats->variance > 0 ? stats->fourth_moment / (stats->variance * stats->variance) - 3.0 : 0.0;
 }
 
 void print_stats(Summary_stats* result)
 {
-    printf("Result {\n  N_samples: %luM\n  Min:  %15.10lf\n  Max:  %15.10lf\n  Mean: %15.10lf\n  Var:  %15.10lf\n}\n", result->n_samples / MILLION, result->min, result->max, result->mean, result->variance);
+    printf("Result {\n  N_samples: %luM\n  Min:  %15.10lf\n  Max:  %15.10lf\n  Mean: %15.10lf\n  Var:  %15.10lf\n  Skew: %15.10lf\n  Kurt: %15.10lf (excess)\n}\n", result->n_samples / MILLION, result->min, result->max, result->mean, result->variance, skewness(result), excess_kurtosis(result));
 
-    print_histogram(result->histogram.bins, result->histogram.n_bins, result->histogram.min, result->histogram.bin_width);
+    histogram_print(&result->histogram);
+    print_variance_reduction(&result->variance_reduction, result->n_samples, result->mean, result->variance);
+    print_tail(&result->tail);
+    print_sensitivity(&result->sensitivity);
+    if (result->n_differences > 0) {
+        double n = (double)result->n_differences;
+        double shifted_mean = exact_sum_value(&result->difference_sums[0]) / n;
+        double variance = exact_sum_value(&result->difference_sums[1]) / n - shifted_mean * shifted_mean;
+        printf("Difference with first variant {\n  Mean: %15.10lf\n  Var:  %15.10lf\n  Standard error of the mean: %15.10lf\n}\n", result->difference_shift + shifted_mean, variance, sqrt(variance / n));
+    }
 
     if (COLLECT_OUTLIERS) {
         printf("\nOutliers: ");
@@ -133,15 +548,480 @@ void print_stats(Summary_stats* result)
     }
 }
 
+/* Wall time per phase of the iterations, for scaling runs (see benchmarks/scaling.sh) */
+typedef struct _Phase_times {
+    double setup; // allocations, seeds, thread pools
+    double sampling;
+    double statistics; // reductions, histogram, tail, convergence and sensitivity
+    double gather; // barrier, node aggregation, gather to process 0 and handing the report over
+    double total; // including the last report
+} Phase_times;
+
+static void print_phase_times(Phase_times* times, int mpi_id, uint64_t n_samples_drawn)
+{
+    // The slowest process sets the pace, so this is the max over processes
+    IF_MPI(MPI_Reduce(mpi_id == 0 ? MPI_IN_PLACE : times, times, sizeof(Phase_times) / sizeof(double), MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD));
+    IF_MPI(MPI_Reduce(mpi_id == 0 ? MPI_IN_PLACE : &n_samples_drawn, &n_samples_drawn, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD));
+    if (mpi_id != 0) return;
+    printf("Time per phase (max over processes) {\n  Setup:       %10.3lfs\n  Sampling:    %10.3lfs\n  Statistics:  %10.3lfs\n  Gather:      %10.3lfs\n  Total:       %10.3lfs\n  Samples:     %lu, %.4e per second\n}\n",
+        times->setup, times->sampling, times->statistics, times->gather, times->total, n_samples_drawn, (double)n_samples_drawn / times->total);
+}
+
+#ifdef SQUIGGLE_INSTRUMENT
+/*
+Cost counters, from an instrumented build (make build-instrumented): what the samplers drew, summed over every thread of every process,
+per call of the model. They count every draw, including those of the sensitivity analysis, if any.
+Counters are kept per sampler function, not per call site: keying them by call site would put a lookup in every draw, and the cost of a
+model is what it calls, not where from. Time is that of the sampling loops, as wall time times the number of threads, so it includes
+threads waiting at the end of a loop; the spread of draws over threads shows how uneven the work was
+*/
+static void print_squiggle_counters(int mpi_id, int n_threads, double sampling_seconds, uint64_t n_sampler_calls)
+{
+    Squiggle_counters* per_thread;
+    int n_counted_threads = squiggle_counters_get(&per_thread);
+    int n_fields = (int)(sizeof(Squiggle_counters) / sizeof(uint64_t));
+    uint64_t totals[sizeof(Squiggle_counters) / sizeof(uint64_t)] = { 0 };
+    uint64_t least_draws = UINT64_MAX;
+    uint64_t most_draws = 0;
+    for (int t = 0; t < n_counted_threads; t++) {
+        for (int f = 0; f < n_fields; f++) {
+            totals[f] += ((uint64_t*)&per_thread[t])[f];
+        }
+        if (least_draws > per_thread[t].xorshift_draws) least_draws = per_thread[t].xorshift_draws;
+        if (most_draws < per_thread[t].xorshift_draws) most_draws = per_thread[t].xorshift_draws;
+    }
+    double thread_seconds = sampling_seconds * n_threads;
+    IF_MPI(MPI_Reduce(mpi_id == 0 ? MPI_IN_PLACE : totals, totals, n_fields, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD));
+    IF_MPI(MPI_Reduce(mpi_id == 0 ? MPI_IN_PLACE : &least_draws, &least_draws, 1, MPI_UINT64_T, MPI_MIN, 0, MPI_COMM_WORLD));
+    IF_MPI(MPI_Reduce(mpi_id == 0 ? MPI_IN_PLACE : &most_draws, &most_draws, 1, MPI_UINT64_T, MPI_MAX, 0, MPI_COMM_WORLD));
+    IF_MPI(MPI_Reduce(mpi_id == 0 ? MPI_IN_PLACE : &n_sampler_calls, &n_sampler_calls, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD));
+    IF_MPI(MPI_Reduce(mpi_id == 0 ? MPI_IN_PLACE : &thread_seconds, &thread_seconds, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD));
+    if (mpi_id != 0 || n_sampler_calls == 0) return;
+
+    Squiggle_counters* total = (Squiggle_counters*)totals;
+    double calls = (double)n_sampler_calls;
+    uint64_t gamma_proposals = total->gamma_rejections + total->gamma_calls - total->gamma_alpha_below_one; // each call with alpha >= 1 accepts once
+    printf("Sampler costs, per model call {\n");
+    printf("  Model calls:        %lu\n", n_sampler_calls);
+    printf("  Wall x threads:     %10.2lf ns\n", thread_seconds * 1e9 / calls);
+    printf("  xorshift64 draws:   %10.4lf\n", (double)total->xorshift_draws / calls);
+    printf("  Unit normals:       %10.4lf\n", (double)total->unit_normals / calls);
+    printf("  Lognormals:         %10.4lf, of which from sample_to: %.4lf\n", (double)total->lognormal_calls / calls, (double)total->to_calls / calls);
+    printf("  Betas:              %10.4lf\n", (double)total->beta_calls / calls);
+    printf("  Gammas:             %10.4lf, of which with alpha < 1: %.4lf\n", (double)total->gamma_calls / calls, (double)total->gamma_alpha_below_one / calls);
+    printf("  Gamma rejections:   %10.4lf, or %.2lf%% of proposals\n", (double)total->gamma_rejections / calls, gamma_proposals > 0 ? 100.0 * (double)total->gamma_rejections / (double)gamma_proposals : 0.0);
+    printf("  Draws per thread:   %lu to %lu\n", least_draws, most_draws);
+    printf("}\n");
+}
+#endif
+
+static void byte_buffer_reserve(Byte_buffer* buffer, size_t capacity)
+{
+    if (buffer->capacity < capacity) {
+        size_t new_capacity = capacity > 2 * buffer->capacity ? capacity : 2 * buffer->capacity;
+        unsigned char* new_bytes = (unsigned char*)realloc(buffer->bytes, new_capacity);
+        if (new_bytes == NULL) {
+            // Called between collectives, where returning an error would leave the other processes waiting
+            fprintf(stderr, "Memory reallocation for a byte buffer of %zu bytes failed.\n", new_capacity);
+            IF_MPI(MPI_Abort(MPI_COMM_WORLD, 1));
+            exit(1);
+        }
+        buffer->bytes = new_bytes;
+        buffer->capacity = new_capacity;
+    }
+}
+
+#ifndef NO_MPI
+// Appends the serialized histograms of all ranks in comm to received, on its rank 0, and fills in their sizes and offsets there
+static void gather_histograms(Histogram* histogram, Byte_buffer* sent, Byte_buffer* received, int* sizes, int* offsets, MPI_Comm comm)
+{
+    int rank, n_ranks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &n_ranks);
+    byte_buffer_reserve(sent, histogram_serialized_size_bound(histogram));
+    int size = (int)histogram_serialize(histogram, sent->bytes);
+    MPI_Gather(&size, 1, MPI_INT, sizes, 1, MPI_INT, 0, comm);
+    if (rank == 0) {
+        for (int r = 0; r < n_ranks; r++) {
+            offsets[r] = (int)received->size;
+            received->size += (size_t)sizes[r];
+        }
+        byte_buffer_reserve(received, received->size);
+    }
+    MPI_Gatherv(sent->bytes, size, MPI_BYTE, rank == 0 ? received->bytes : NULL, sizes, offsets, MPI_BYTE, 0, comm);
+}
+
+/*
+Node aggregation: each rank copies its stats into its own slot of an MPI-3 shared memory window,
+and the node's leader merges the slots in place, without any messages.
+Histograms, whose size varies, go to the leader as messages instead, serialized.
+Then only the leaders, one per node, take part in the gather to rank 0
+*/
+typedef struct _Node_aggregation {
+    MPI_Comm node_comm;
+    MPI_Comm leaders_comm; // MPI_COMM_NULL on ranks that aren't leaders
+    int node_rank;
+    int node_size;
+    int n_nodes;
+    MPI_Win window;
+    char** slots; // per node rank: n_variants Summary_stats, then a Convergence
+    Byte_buffer sent_histogram;
+    Byte_buffer received_histograms; // leader only, and the following
+    int* histogram_sizes; // [variant][node rank]
+    int* histogram_offsets;
+    Summary_stats* merged_stats;
+    Convergence merged_convergence;
+} Node_aggregation;
+
+static size_t node_slot_size(int n_variants)
+{
+    return (size_t)n_variants * sizeof(Summary_stats) + sizeof(Convergence);
+}
+
+static void node_aggregation_init(Node_aggregation* node, int n_variants, const Finisterrae_params* finisterrae)
+{
+    int mpi_id;
+    MPI_Comm_rank(MPI_COMM_WORLD, &mpi_id);
+    // Key 0 keeps world order, so world rank 0 is its node's leader
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node->node_comm);
+    MPI_Comm_rank(node->node_comm, &node->node_rank);
+    MPI_Comm_size(node->node_comm, &node->node_size);
+    MPI_Comm_split(MPI_COMM_WORLD, node->node_rank == 0 ? 0 : MPI_UNDEFINED, mpi_id, &node->leaders_comm);
+    int is_leader = node->node_rank == 0;
+    node->n_nodes = is_leader;
+    MPI_Allreduce(MPI_IN_PLACE, &node->n_nodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    char* own_slot;
+    MPI_Win_allocate_shared((MPI_Aint)node_slot_size(n_variants), 1, MPI_INFO_NULL, node->node_comm, &own_slot, &node->window);
+    node->slots = (char**)malloc((size_t)node->node_size * sizeof(char*));
+    for (int r = 0; r < node->node_size; r++) {
+        MPI_Aint size;
+        int displacement_unit;
+        MPI_Win_shared_query(node->window, r, &size, &displacement_unit, &node->slots[r]);
+    }
+    // Passive target epoch for the whole run; MPI_Win_sync and barriers order the loads and stores
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, node->window);
+    node->sent_histogram = (Byte_buffer) { 0 };
+    node->received_histograms = (Byte_buffer) { 0 };
+    node->histogram_sizes = is_leader ? (int*)malloc((size_t)n_variants * node->node_size * sizeof(int)) : NULL;
+    node->histogram_offsets = is_leader ? (int*)malloc((size_t)n_variants * node->node_size * sizeof(int)) : NULL;
+    node->merged_stats = is_leader ? (Summary_stats*)malloc((size_t)n_variants * sizeof(Summary_stats)) : NULL;
+    for (int v = 0; is_leader && v < n_variants; v++) {
+        node->merged_stats[v].histogram = histogram_init(finisterrae->histogram_min, finisterrae->histogram_sup, finisterrae->histogram_bin_width, finisterrae->histogram_n_bins);
+    }
+}
+
+static void node_aggregate(Node_aggregation* node, Summary_stats* stats, Convergence* convergence, int n_variants)
+{
+    char* own_slot = node->slots[node->node_rank];
+    Summary_stats* own_stats = (Summary_stats*)own_slot;
+    for (int v = 0; v < n_variants; v++) {
+        own_stats[v] = stats[v];
+    }
+    memcpy(own_slot + (size_t)n_variants * sizeof(Summary_stats), convergence, sizeof(Convergence));
+    MPI_Win_sync(node->window);
+    MPI_Barrier(node->node_comm);
+    MPI_Win_sync(node->window);
+
+    node->received_histograms.size = 0;
+    for (int v = 0; v < n_variants; v++) {
+        gather_histograms(&stats[v].histogram, &node->sent_histogram, &node->received_histograms,
+            node->histogram_sizes != NULL ? node->histogram_sizes + (size_t)v * node->node_size : NULL,
+            node->histogram_offsets != NULL ? node->histogram_offsets + (size_t)v * node->node_size : NULL, node->node_comm);
+    }
+
+    if (node->node_rank == 0) {
+        memcpy(&node->merged_convergence, convergence, sizeof(Convergence));
+        for (int v = 0; v < n_variants; v++) {
+            Histogram merged_histogram = node->merged_stats[v].histogram;
+            histogram_clear(&merged_histogram);
+            node->merged_stats[v] = stats[v];
+            node->merged_stats[v].histogram = merged_histogram;
+            for (int r = 0; r < node->node_size; r++) {
+                size_t index = (size_t)v * node->node_size + r;
+                histogram_merge_serialized(&node->merged_stats[v].histogram, node->received_histograms.bytes + node->histogram_offsets[index], (size_t)node->histogram_sizes[index]);
+            }
+        }
+        for (int r = 1; r < node->node_size; r++) {
+            Summary_stats* slot_stats = (Summary_stats*)node->slots[r];
+            for (int v = 0; v < n_variants; v++) {
+                reduce_chunk_stats(&node->merged_stats[v], &slot_stats[v], 1);
+            }
+            convergence_merge(&node->merged_convergence, (Convergence*)(node->slots[r] + (size_t)n_variants * sizeof(Summary_stats)));
+        }
+    }
+    // Slots are only overwritten once the leader is done with them
+    MPI_Barrier(node->node_comm);
+}
+
+static void node_aggregation_free(Node_aggregation* node, int n_variants)
+{
+    MPI_Win_unlock_all(node->window);
+    MPI_Win_free(&node->window);
+    free(node->slots);
+    free(node->sent_histogram.bytes);
+    free(node->received_histograms.bytes);
+    free(node->histogram_sizes);
+    free(node->histogram_offsets);
+    for (int v = 0; node->merged_stats != NULL && v < n_variants; v++) {
+        histogram_free(&node->merged_stats[v].histogram);
+    }
+    free(node->merged_stats);
+    if (node->leaders_comm != MPI_COMM_NULL) MPI_Comm_free(&node->leaders_comm);
+    MPI_Comm_free(&node->node_comm);
+}
+#endif
+
+static void write_status_file(Report_context* context, Report* report)
+{
+    FILE* file = status_file_begin(context->finisterrae->status_file);
+    if (file == NULL) return;
+    fprintf(file, "{\n  \"iteration\": %lu,\n  \"peak_rss_gb\": %.3f,\n  \"variants\": [\n", report->iteration, report->peak_rss);
+    for (int v = 0; v < context->n_variants; v++) {
+        Summary_stats* stats = &context->aggregated_stats[v];
+        fprintf(file, "    { \"name\": ");
+        status_file_write_string(file, context->variants[v].name != NULL ? context->variants[v].name : "");
+        fprintf(file, ", \"n_samples\": %lu, \"mean\": %.12g, \"variance\": %.12g, \"skewness\": %.12g, \"excess_kurtosis\": %.12g, \"min\": %.12g, \"max\": %.12g }%s\n",
+            stats->n_samples, stats->mean, stats->variance, skewness(stats), excess_kurtosis(stats), stats->min, stats->max, v + 1 < context->n_variants ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (status_file_commit(file, context->finisterrae->status_file) != 0) {
+        fprintf(stderr, "Could not replace status file %s\n", context->finisterrae->status_file);
+    }
+}
+
+static void consume_report(void* slot, void* context_arg)
+{
+    Report* report = (Report*)slot;
+    Report_context* context = (Report_context*)context_arg;
+    const Finisterrae_params* finisterrae = context->finisterrae;
+    int n_processes = report->n_sources;
+    context->n_sources = n_processes;
+    for (int v = 0; v < context->n_variants; v++) {
+        Summary_stats* process_stats = report->process_stats + (size_t)v * n_processes;
+        reduce_chunk_stats(&context->aggregated_stats[v], process_stats, n_processes);
+        for (int p = 0; p < n_processes; p++) {
+            size_t index = (size_t)v * n_processes + p;
+            if (histogram_merge_serialized(&context->aggregated_stats[v].histogram, report->process_histograms.bytes + report->histogram_offsets[index], (size_t)report->histogram_sizes[index]) != 0) {
+                fprintf(stderr, "Malformed histogram from source %d\n", p);
+            }
+        }
+    }
+    memcpy(context->process_convergences, report->process_convergences, (size_t)n_processes * sizeof(Convergence));
+    if (finisterrae->status_file != NULL) {
+        write_status_file(context, report);
+    }
+
+    double now = omp_get_wtime();
+    if (report->iteration % finisterrae->print_every_n_iters == 0 && now - context->last_print_time >= finisterrae->print_min_seconds) {
+        context->last_print_time = now;
+        for (int v = 0; v < context->n_variants; v++) {
+            if (context->variants[v].name != NULL) {
+                printf("\nIter %3ld, %s:\n", report->iteration, context->variants[v].name);
+            } else {
+                printf("\nIter %3ld:\n", report->iteration);
+            }
+            print_stats(&context->aggregated_stats[v]);
+        }
+        print_convergence(context->process_convergences, n_processes);
+        printf("Peak RSS (max over processes): %.3f GB\n", report->peak_rss);
+        fflush(stdout);
+    }
+}
+
+/*
+Shard files (see shard.h): per variant, its Summary_stats and serialized histogram, prefixed by its size;
+then the number of sources, processes or nodes, and the convergence of each
+*/
+static uint64_t shard_layout(void)
+{
+    return (uint64_t)sizeof(Summary_stats) << 32 | (uint64_t)sizeof(Convergence);
+}
+
+static void byte_buffer_append(Byte_buffer* buffer, const void* data, size_t size)
+{
+    byte_buffer_reserve(buffer, buffer->size + size);
+    memcpy(buffer->bytes + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static int write_shard_file(const Finisterrae_params* finisterrae, Summary_stats* stats, int n_variants, Convergence* convergences, int n_sources)
+{
+    Byte_buffer payload = { 0 };
+    for (int v = 0; v < n_variants; v++) {
+        byte_buffer_append(&payload, &stats[v], sizeof(Summary_stats));
+        uint64_t histogram_size = 0;
+        size_t size_offset = payload.size;
+        byte_buffer_append(&payload, &histogram_size, sizeof(histogram_size));
+        byte_buffer_reserve(&payload, payload.size + histogram_serialized_size_bound(&stats[v].histogram));
+        histogram_size = histogram_serialize(&stats[v].histogram, payload.bytes + payload.size);
+        memcpy(payload.bytes + size_offset, &histogram_size, sizeof(histogram_size));
+        payload.size += histogram_size;
+    }
+    uint64_t n_convergences = (uint64_t)n_sources;
+    byte_buffer_append(&payload, &n_convergences, sizeof(n_convergences));
+    byte_buffer_append(&payload, convergences, (size_t)n_sources * sizeof(Convergence));
+
+    Shard_header header = {
+        .shard_index = finisterrae->shard_index,
+        .shard_count = finisterrae->shard_count,
+        .n_samples = stats[0].n_samples,
+        .layout = shard_layout(),
+        .payload_size = payload.size,
+        .n_variants = n_variants,
+        .histogram_n_bins = finisterrae->histogram_n_bins,
+        .histogram_min = finisterrae->histogram_min,
+        .histogram_sup = finisterrae->histogram_sup,
+        .histogram_bin_width = finisterrae->histogram_bin_width,
+    };
+    snprintf(header.model_code_hash, SHARD_HASH_LENGTH, "%s", MODEL_CODE_HASH);
+    int result = shard_file_write(finisterrae->shard_file, &header, payload.bytes);
+    if (result == 0) printf("Wrote shard %lu of %lu to %s\n", header.shard_index, header.shard_count, finisterrae->shard_file);
+    free(payload.bytes);
+    return result;
+}
+
+typedef struct _Shard {
+    const char* path;
+    Shard_header header;
+    unsigned char* payload;
+} Shard;
+
+static int compare_shards(const void* a, const void* b)
+{
+    uint64_t index_a = ((const Shard*)a)->header.shard_index;
+    uint64_t index_b = ((const Shard*)b)->header.shard_index;
+    return (index_a > index_b) - (index_a < index_b);
+}
+
+// Reads n bytes at *offset of the shard's payload into out, if there are that many left
+static int shard_payload_read(Shard* shard, size_t* offset, void* out, size_t n)
+{
+    if (n > shard->header.payload_size - *offset) return 1;
+    memcpy(out, shard->payload + *offset, n);
+    *offset += n;
+    return 0;
+}
+
+/*
+Offline merge of shard files, without MPI: ./samples --merge shard_*.bin, with the same model and parameters as the shards.
+Shards are merged in order of their index, so the result doesn't depend on the order of the files either
+*/
+static int merge_shard_files(Finisterrae_params finisterrae, char** paths, int n_paths)
+{
+    int n_variants = finisterrae.n_variants > 0 ? finisterrae.n_variants : 1;
+    Finisterrae_variant default_variant = { .name = NULL };
+    const Finisterrae_variant* variants = finisterrae.n_variants > 0 ? finisterrae.variants : &default_variant;
+
+    Shard* shards = (Shard*)calloc((size_t)n_paths, sizeof(Shard));
+    int ok = 1;
+    for (int f = 0; f < n_paths && ok; f++) {
+        shards[f].path = paths[f];
+        shards[f].payload = shard_file_read(paths[f], &shards[f].header);
+        Shard_header* header = &shards[f].header;
+        if (shards[f].payload == NULL) {
+            fprintf(stderr, "Could not read shard file %s\n", paths[f]);
+            ok = 0;
+        } else if (header->layout != shard_layout() || header->n_variants != n_variants || header->histogram_n_bins != finisterrae.histogram_n_bins
+            || header->histogram_min != finisterrae.histogram_min || header->histogram_sup != finisterrae.histogram_sup || header->histogram_bin_width != finisterrae.histogram_bin_width) {
+            fprintf(stderr, "Shard file %s is from a build with other parameters than this one\n", paths[f]);
+            ok = 0;
+        } else if (strncmp(header->model_code_hash, MODEL_CODE_HASH, SHARD_HASH_LENGTH) != 0 || header->shard_count != shards[0].header.shard_count) {
+            fprintf(stderr, "Shard file %s is from another model or run: model %s, %lu shards, where %s has model %s, %lu shards\n",
+                paths[f], header->model_code_hash, header->shard_count, paths[0], shards[0].header.model_code_hash, shards[0].header.shard_count);
+            ok = 0;
+        }
+    }
+    qsort(shards, (size_t)n_paths, sizeof(Shard), compare_shards);
+    for (int f = 1; f < n_paths && ok; f++) {
+        if (shards[f].header.shard_index == shards[f - 1].header.shard_index) {
+            // Its samples would be counted twice
+            fprintf(stderr, "Shard %lu is in both %s and %s\n", shards[f].header.shard_index, shards[f - 1].path, shards[f].path);
+            ok = 0;
+        }
+    }
+
+    Summary_stats* aggregated_stats = (Summary_stats*)malloc((size_t)n_variants * sizeof(Summary_stats));
+    for (int v = 0; v < n_variants; v++) {
+        aggregated_stats[v] = aggregate_stats_init(&finisterrae, v);
+    }
+    Convergence* convergences = NULL;
+    int n_convergences = 0;
+    for (int f = 0; f < n_paths && ok; f++) {
+        size_t offset = 0;
+        for (int v = 0; v < n_variants && ok; v++) {
+            Summary_stats shard_stats;
+            uint64_t histogram_size;
+            ok = shard_payload_read(&shards[f], &offset, &shard_stats, sizeof(Summary_stats)) == 0
+                && shard_payload_read(&shards[f], &offset, &histogram_size, sizeof(histogram_size)) == 0
+                && histogram_size <= shards[f].header.payload_size - offset
+                && histogram_merge_serialized(&aggregated_stats[v].histogram, shards[f].payload + offset, (size_t)histogram_size) == 0;
+            if (!ok) break;
+            offset += (size_t)histogram_size;
+            shard_stats.outliers.n = 0; // its buffer was another process's
+            reduce_chunk_stats(&aggregated_stats[v], &shard_stats, 1);
+        }
+        uint64_t n_sources = 0;
+        ok = ok && shard_payload_read(&shards[f], &offset, &n_sources, sizeof(n_sources)) == 0
+            && n_sources <= (shards[f].header.payload_size - offset) / sizeof(Convergence);
+        if (ok) {
+            convergences = (Convergence*)realloc(convergences, (size_t)(n_convergences + (int)n_sources) * sizeof(Convergence));
+            ok = shard_payload_read(&shards[f], &offset, convergences + n_convergences, (size_t)n_sources * sizeof(Convergence)) == 0;
+            n_convergences += (int)n_sources;
+        }
+        if (!ok) fprintf(stderr, "Malformed shard file %s\n", shards[f].path);
+    }
+
+    if (ok) {
+        uint64_t shard_count = shards[0].header.shard_count;
+        printf("Merged %d of %lu shards\n", n_paths, shard_count);
+        if ((uint64_t)n_paths < shard_count) {
+            printf("Missing shards:");
+            for (uint64_t index = 0, f = 0; index < shard_count; index++) {
+                if (f < (uint64_t)n_paths && shards[f].header.shard_index == index) {
+                    f++;
+                } else {
+                    printf(" %lu", index);
+                }
+            }
+            printf("\n");
+        }
+        for (int v = 0; v < n_variants; v++) {
+            if (variants[v].name != NULL) {
+                printf("\nMerged, %s:\n", variants[v].name);
+            } else {
+                printf("\nMerged:\n");
+            }
+            print_stats(&aggregated_stats[v]);
+        }
+        print_convergence(convergences, n_convergences);
+    }
+
+    for (int v = 0; v < n_variants; v++) {
+        histogram_free(&aggregated_stats[v].histogram);
+        free(aggregated_stats[v].outliers.os);
+    }
+    free(aggregated_stats);
+    free(convergences);
+    for (int f = 0; f < n_paths; f++) {
+        free(shards[f].payload);
+    }
+    free(shards);
+    return !ok;
+}
+
 int sampler_finisterrae(Finisterrae_params finisterrae)
 {
     // Histogram parameters: histogram_min, histogram_sup
     // START MPI ENVIRONMENT
     int mpi_id = 0, n_processes = 1;
     MPI_Status status;
-    IF_MPI(MPI_Init(NULL, NULL));
+    // MPI is initialized and finalized by main, so that this can run more than once
     IF_MPI(MPI_Comm_size(MPI_COMM_WORLD, &n_processes));
     IF_MPI(MPI_Comm_rank(MPI_COMM_WORLD, &mpi_id));
+    double start_time = omp_get_wtime();
+    Phase_times phase_times = { 0 };
+    int exit_code = 0;
 
     /*
     Three levels:
@@ -150,36 +1030,28 @@ int sampler_finisterrae(Finisterrae_params finisterrae)
     - aggregated_mpi_processes_stats: and we will reduce the array into one global stats again
     */
 
-    Summary_stats individual_mpi_process_stats;
-    Summary_stats* mpi_processes_stats_array = (Summary_stats*)malloc(n_processes * sizeof(Summary_stats));
-    Summary_stats aggregated_mpi_processes_stats;
-
-    uint64_t* aggregate_histogram_bins = (uint64_t*)calloc((size_t)finisterrae.histogram_n_bins, sizeof(uint64_t));
-    Histogram aggregate_histogram = {
-        .min = finisterrae.histogram_min,
-        .sup = finisterrae.histogram_sup,
-        .bin_width = finisterrae.histogram_bin_width,
-        .n_bins = finisterrae.histogram_n_bins,
-        .bins = aggregate_histogram_bins,
-    };
-    uint64_t* seed = malloc(sizeof(uint64_t));
-    *seed = UINT64_MAX / 2 + mpi_id;
-    double s = finisterrae.sampler(seed);
-    free(seed);
-    double* os = NULL;
-    if (COLLECT_OUTLIERS) {
-        os = (double*)malloc((size_t)100 * sizeof(double));
+    /*
+    Each of these is per variant. Without variants, there is a single one, drawn from finisterrae.sampler
+    */
+    int n_variants = finisterrae.n_variants > 0 ? finisterrae.n_variants : 1;
+    Finisterrae_variant default_variant = { .name = NULL, .sampler = (double (*)(uint64_t*))finisterrae.sampler };
+    const Finisterrae_variant* variants = finisterrae.n_variants > 0 ? finisterrae.variants : &default_variant;
+    int use_variance_reduction = finisterrae.antithetic || finisterrae.control_variate_model != NULL;
+    if ((finisterrae.batch_sampler != NULL) + (finisterrae.n_variants > 0) + use_variance_reduction > 1) {
+        fprintf(stderr, "batch_sampler, variants and variance reduction (antithetic, control_variate_model) can't be combined.\n");
+        return 1;
+    }
+    if (finisterrae.antithetic && !SQUIGGLE_HAS_ANTITHETIC) {
+        fprintf(stderr, "Antithetic sampling needs a build with reflected uniforms, e.g., make build-antithetic.\n");
+        return 1;
+    }
+
+    Summary_stats* individual_mpi_process_stats = (Summary_stats*)malloc(n_variants * sizeof(Summary_stats));
+    Summary_stats* aggregated_mpi_processes_stats = (Summary_stats*)malloc(n_variants * sizeof(Summary_stats));
+
+    for (int v = 0; v < n_variants; v++) {
+        aggregated_mpi_processes_stats[v] = aggregate_stats_init(&finisterrae, v);
     }
-    Outliers aggregate_histogram_outliers = { .os = os, .n = 0, .capacity = 100 };
-    aggregated_mpi_processes_stats = (Summary_stats) {
-        .n_samples = 1,
-        .min = s,
-        .max = s,
-        .mean = s,
-        .variance = 0.0,
-        .histogram = aggregate_histogram,
-        .outliers = aggregate_histogram_outliers,
-    };
     // Get the number of threads
     int n_threads;
     #pragma omp parallel // Create a parallel environment to see how many threads are in it
@@ -194,109 +1066,346 @@ int sampler_finisterrae(Finisterrae_params finisterrae)
     // either get num threads or set num threads; either delete this statement or the omp_get_num_threads one
     */
 
-    // Initialize seeds
-    seed_cache_box* cache_box = (seed_cache_box*)malloc(sizeof(seed_cache_box) * (size_t)n_threads);
+    // Initialize seeds: the starts of substreams of this shard's segment, see shard.h. Runs without shards are shard 0 of 1.
+    // One substream per process for the samples, then as many for the sensitivity analysis, so that the main samples
+    // don't change when it's turned on. Chunks are placed inside them, see chunk_seed
+    int use_shards = finisterrae.shard_count > 0;
+    if (use_shards && (finisterrae.shard_index >= finisterrae.shard_count || finisterrae.shard_file == NULL)) {
+        fprintf(stderr, "Shard mode needs shard_index < shard_count and a shard_file.\n");
+        return 1;
+    }
+    uint64_t shard_index = use_shards ? finisterrae.shard_index : 0;
+    uint64_t shard_count = use_shards ? finisterrae.shard_count : 1;
+    uint64_t n_streams = 2 * (uint64_t)n_processes;
+    uint64_t process_seed;
+    uint64_t sensitivity_seed;
+    shard_stream_seeds(shard_index, shard_count, n_streams, (uint64_t)mpi_id, 1, &process_seed);
+    shard_stream_seeds(shard_index, shard_count, n_streams, (uint64_t)(n_processes + mpi_id), 1, &sensitivity_seed);
+    uint64_t n_stream_chunks = shard_stream_length(shard_count, n_streams) / CHUNK_STRIDE;
+    if (use_shards && mpi_id == 0) printf("Shard %lu of %lu: RNG substreams of %lu chunks per process\n", shard_index, shard_count, n_stream_chunks);
+    Xorshift_jumps* jumps = (Xorshift_jumps*)malloc(sizeof(Xorshift_jumps));
+    if (jumps == NULL) {
+        fprintf(stderr, "Memory allocation for the RNG jump table failed\n");
+        return 1;
+    }
+    xorshift_jumps_init(jumps);
+    Sensitivity_stats* sensitivity_thread_stats = NULL;
+    if (finisterrae.sensitivity_model != NULL) {
+        sensitivity_thread_stats = (Sensitivity_stats*)malloc(sizeof(Sensitivity_stats) * (size_t)n_threads);
+    }
+    // Chunk of samples per iteration: these are per mpi process, distributed between threads
+    int64_t n_samples = (int64_t)finisterrae.n_samples_per_process;
+    uint64_t memory_budget = finisterrae.memory_budget_per_process > 0 ? finisterrae.memory_budget_per_process : memory_budget_from_slurm();
+    if (memory_budget > 0) {
+        // Everything but the samples themselves is fixed size, give or take the histograms' sparse tails.
+        // Serialized histograms in the report slots take about as much as dense ones, or less
+        uint64_t histogram_bytes = (uint64_t)(finisterrae.histogram_n_bins < HISTOGRAM_MAX_DENSE_BINS ? finisterrae.histogram_n_bins : HISTOGRAM_MAX_DENSE_BINS) * sizeof(uint64_t);
+        uint64_t fixed_bytes = (uint64_t)(2 * n_variants + N_REPORT_SLOTS * n_variants * n_processes) * (sizeof(Summary_stats) + histogram_bytes)
+            + (uint64_t)(N_REPORT_SLOTS * n_processes + 2) * sizeof(Convergence)
+            + (uint64_t)n_threads * (sizeof(Tail_stats) + sizeof(Sensitivity_stats))
+            + (use_variance_reduction ? (finisterrae.n_samples_per_process / SAMPLING_CHUNK_SIZE + 1) * sizeof(Variance_reduction_stats) : 0);
+        n_samples = chunk_size_for_budget(memory_budget, fixed_bytes, (uint64_t)n_variants * sizeof(double), finisterrae.n_samples_per_process);
+        printf("Chunk size on process %d: %ld samples, for a memory budget of %.3f GB\n", mpi_id, n_samples, (double)memory_budget / (double)(MEGABYTE * 1024));
+    }
 
-    int mpi_seed = mpi_id + 1; // +i*n_processes;
-    srand(mpi_seed); /* Another alternative would be to distribute the seeds evenly, but I'm afraid that if I do this they'll end up somehow correlated */
-    for (int thread_id = 0; thread_id < n_threads; thread_id++) {
-        // Nuño to Jorge: you can't do this in parallel, since rand() is not thread safe
-        cache_box[thread_id].seed = (uint64_t)rand() * (UINT64_MAX / RAND_MAX);
+    // A shard's share of the total, with the remainder going to the first shards
+    uint64_t n_samples_total = finisterrae.n_samples_total;
+    if (use_shards) {
+        n_samples_total = finisterrae.n_samples_total / finisterrae.shard_count + (finisterrae.shard_index < finisterrae.n_samples_total % finisterrae.shard_count ? 1 : 0);
     }
-    int n_samples = finisterrae.n_samples_per_process; /* these are per mpi process, distributed between threads  */
-    double* xs = (double*)malloc((size_t)n_samples * sizeof(double));
-    double* samples = (double*)malloc((size_t)n_samples * sizeof(double));
-    if (samples == NULL) {
+    // Every iteration draws n_samples per process but the last, which draws what's left, spread over processes as evenly as possible
+    uint64_t n_samples_per_iteration = (uint64_t)n_samples * (uint64_t)n_processes;
+    uint64_t n_iterations = (n_samples_total + n_samples_per_iteration - 1) / n_samples_per_iteration;
+    // Chunks have to fit in the substreams: n_chunks a iteration, plus one for the odd sample left over by antithetic pairs
+    uint64_t n_chunk_slots = (uint64_t)((n_samples + SAMPLING_CHUNK_SIZE - 1) / SAMPLING_CHUNK_SIZE) + (use_variance_reduction ? 1 : 0);
+    int64_t n_sensitivity_samples = (int64_t)finisterrae.sensitivity_n_samples_per_process;
+    int64_t n_sensitivity_chunks = (n_sensitivity_samples + SENSITIVITY_CHUNK_SIZE - 1) / SENSITIVITY_CHUNK_SIZE;
+    uint64_t n_chunks_needed = n_iterations * (n_chunk_slots > (uint64_t)n_sensitivity_chunks ? n_chunk_slots : (uint64_t)n_sensitivity_chunks);
+    if (n_chunks_needed > n_stream_chunks) {
+        fprintf(stderr, "This run needs up to %lu chunks per process, more than its RNG substreams hold (%lu), see shard.h.\n", n_chunks_needed, n_stream_chunks);
+        free(jumps);
+        return 1;
+    }
+
+    /*
+    Everything the iterations use is allocated here, once, and reused across iterations:
+    - an arena with the samples of all variants, variant after variant
+    - the histogram bins and outlier buffers of each process's stats
+    - the variance reduction stats of each chunk, which are merged in chunk order, so that they don't depend on the threads either
+    */
+    double* xs_arena = (double*)malloc((size_t)n_variants * (size_t)n_samples * sizeof(double));
+    if (xs_arena == NULL) {
         fprintf(stderr, "Memory allocation for samples failed.\n");
         return 1;
     }
+    double** variant_xs = (double**)malloc(n_variants * sizeof(double*));
+    for (int v = 0; v < n_variants; v++) {
+        variant_xs[v] = xs_arena + (size_t)v * (size_t)n_samples;
+    }
+    double* xs = variant_xs[0];
+    int64_t n_chunks = (n_samples + SAMPLING_CHUNK_SIZE - 1) / SAMPLING_CHUNK_SIZE;
+    Variance_reduction_stats* variance_reduction_chunk_stats = NULL;
+    if (use_variance_reduction) {
+        variance_reduction_chunk_stats = (Variance_reduction_stats*)malloc(sizeof(Variance_reduction_stats) * (size_t)n_chunks);
+    }
+    int use_work_stealing = finisterrae.backend == BACKEND_WORK_STEALING && finisterrae.n_variants == 0 && finisterrae.batch_sampler == NULL && !use_variance_reduction;
+    Work_pool* work_pool = NULL;
+    Sampling_task sampling_task = { .sampler = (double (*)(uint64_t*))finisterrae.sampler, .xs = xs, .jumps = jumps, .stream_seed = process_seed };
+    Sampling_task sensitivity_task = { .jumps = jumps, .stream_seed = sensitivity_seed };
+    if (use_work_stealing) {
+        work_pool = work_pool_create(n_threads);
+        if (work_pool == NULL) {
+            fprintf(stderr, "Starting the work stealing threads failed.\n");
+            return 1;
+        }
+    }
+    double* shifts = (double*)malloc(n_variants * sizeof(double)); // of each variant's shifted sums, see pilot_mean
+    for (int v = 0; v < n_variants; v++) {
+        shifts[v] = pilot_mean(&finisterrae, &variants[v], v, n_variants);
+    }
+    Byte_buffer histogram_buffer = { 0 }; // this process's histograms, serialized for the gather
+    for (int v = 0; v < n_variants; v++) {
+        individual_mpi_process_stats[v].histogram = histogram_init(finisterrae.histogram_min, finisterrae.histogram_sup, finisterrae.histogram_bin_width, finisterrae.histogram_n_bins);
+        double* os = NULL;
+        if (COLLECT_OUTLIERS) {
+            os = (double*)malloc((size_t)100 * sizeof(double));
+        }
+        individual_mpi_process_stats[v].outliers = (Outliers) { .os = os, .n = 0, .capacity = 100 };
+    }
     // By persisting these variables rather than recreating them with each loop, we
     // 1. Get slightly better pseudo-randomness, I think, as the threads continue and we reduce our reliance on srand
     // 2. Become more slightly more efficient, as we don't have to call and free memory constantly
 
-    uint64_t* all_bins = (uint64_t*)calloc(finisterrae.histogram_n_bins * n_processes, sizeof(uint64_t));
-    for (uint64_t i = 0; i < finisterrae.n_samples_total / (finisterrae.n_samples_per_process*(uint64_t)n_processes)+(uint64_t)1 ; i++) {
+    // Convergence trace of the first variant, at 10^6, 10^7, ... samples
+    // Shards count as processes of one big run, so that checkpoints are at the same sizes once their files are merged
+    Convergence convergence = use_shards
+        ? convergence_init((uint64_t)n_processes * finisterrae.shard_count, finisterrae.shard_index * (uint64_t)n_processes + (uint64_t)mpi_id)
+        : convergence_init((uint64_t)n_processes, (uint64_t)mpi_id);
+
+#ifndef NO_MPI
+    Node_aggregation node;
+    if (finisterrae.node_aggregation) {
+        node_aggregation_init(&node, n_variants, &finisterrae);
+        if (mpi_id == 0) printf("Node aggregation: %d processes on %d nodes\n", n_processes, node.n_nodes);
+    }
+#endif
+
+#ifdef SQUIGGLE_INSTRUMENT
+    uint64_t n_sampler_calls = 0;
+#endif
+
+    // Reporter thread on process 0, with its slots allocated up front too
+    Reporter reporter;
+    Report reports[N_REPORT_SLOTS];
+    void* report_slots[N_REPORT_SLOTS];
+    Report_context report_context = {
+        .finisterrae = &finisterrae,
+        .variants = variants,
+        .n_variants = n_variants,
+        .n_sources = n_processes,
+        .aggregated_stats = aggregated_mpi_processes_stats,
+        .process_convergences = (Convergence*)calloc(n_processes, sizeof(Convergence)),
+        .last_print_time = -INFINITY,
+    };
+    if (mpi_id == 0) {
+        for (int r = 0; r < N_REPORT_SLOTS; r++) {
+            reports[r].process_stats = (Summary_stats*)malloc((size_t)n_variants * n_processes * sizeof(Summary_stats));
+            reports[r].process_histograms = (Byte_buffer) { 0 };
+            reports[r].histogram_sizes = (int*)malloc((size_t)n_variants * n_processes * sizeof(int));
+            reports[r].histogram_offsets = (int*)malloc((size_t)n_variants * n_processes * sizeof(int));
+            reports[r].process_convergences = (Convergence*)malloc((size_t)n_processes * sizeof(Convergence));
+            report_slots[r] = &reports[r];
+        }
+        if (reporter_start(&reporter, report_slots, N_REPORT_SLOTS, consume_report, &report_context) != 0) {
+            fprintf(stderr, "Could not start the reporter thread.\n");
+            return 1;
+        }
+    }
+    uint64_t n_samples_drawn = 0;
+    phase_times.setup = omp_get_wtime() - start_time;
+    for (uint64_t i = 0; i < n_iterations; i++) {
+        if (i == n_iterations - 1) {
+            uint64_t n_samples_left = n_samples_total - i * n_samples_per_iteration;
+            n_samples = (int64_t)(n_samples_left / (uint64_t)n_processes + ((uint64_t)mpi_id < n_samples_left % (uint64_t)n_processes ? 1 : 0));
+            n_chunks = (n_samples + SAMPLING_CHUNK_SIZE - 1) / SAMPLING_CHUNK_SIZE;
+        }
         // Wait until the finisterrae allocator kills this
 
         // sampler_parallel(sample_cost_effectiveness_cser_bps_per_million, samples, n_threads, n_samples, mpi_id+1+i*n_processes);
         // do this inline instead of calling to the sampler_parallel function
 
-        // One parallel loop to get the samples
-        #pragma omp parallel for
-        for (int j = 0; j < n_samples; j++) {
-            int thread_id = omp_get_thread_num();
-            // Can we get the minimum and maximum here? Not quite straightforwardly, because we have different threads operating independently
-            xs[j] = finisterrae.sampler(&(cache_box[thread_id].seed));
-        }
-
-        // Initialize individual process stats struct
-        uint64_t* individual_mpi_process_histogram_bins = (uint64_t*)calloc((size_t)finisterrae.histogram_n_bins, sizeof(uint64_t));
-        Histogram individual_mpi_process_histogram = {
-            .min = finisterrae.histogram_min,
-            .sup = finisterrae.histogram_sup,
-            .bin_width = finisterrae.histogram_bin_width,
-            .n_bins = finisterrae.histogram_n_bins,
-            .bins = individual_mpi_process_histogram_bins,
-        };
-        double* os = NULL;
-        if (COLLECT_OUTLIERS) {
-            os = (double*)malloc((size_t)100 * sizeof(double));
+        // One parallel loop to get the samples, chunk by chunk, see chunk_seed
+        double phase_start = omp_get_wtime();
+        int64_t n_variance_reduction_chunks = 0;
+        if (finisterrae.batch_sampler != NULL) {
+            #pragma omp parallel for
+            for (int64_t chunk = 0; chunk < n_chunks; chunk++) {
+                uint64_t seed = chunk_seed(&sampling_task, chunk);
+                int64_t end = (chunk + 1) * SAMPLING_CHUNK_SIZE < n_samples ? (chunk + 1) * SAMPLING_CHUNK_SIZE : n_samples;
+                for (int64_t j = chunk * SAMPLING_CHUNK_SIZE; j < end; j += SAMPLER_BATCH_SIZE) {
+                    int batch_size = (end - j) < SAMPLER_BATCH_SIZE ? (int)(end - j) : SAMPLER_BATCH_SIZE;
+                    finisterrae.batch_sampler(xs + j, batch_size, &seed);
+                }
+            }
+        } else if (use_variance_reduction) {
+            // Units of one sample, or of an antithetic pair replayed from the same seed
+            const Sensitivity_model* model = finisterrae.control_variate_model;
+            int unit_size = finisterrae.antithetic ? 2 : 1;
+            int64_t n_units = n_samples / unit_size;
+            int64_t units_per_chunk = SAMPLING_CHUNK_SIZE / unit_size;
+            int64_t n_unit_chunks = (n_units + units_per_chunk - 1) / units_per_chunk;
+            #pragma omp parallel for
+            for (int64_t chunk = 0; chunk < n_unit_chunks; chunk++) {
+                uint64_t seed = chunk_seed(&sampling_task, chunk);
+                Variance_reduction_stats* chunk_stats = &variance_reduction_chunk_stats[chunk];
+                *chunk_stats = variance_reduction_stats_init(model, unit_size, shifts[0]);
+                int64_t end = (chunk + 1) * units_per_chunk < n_units ? (chunk + 1) * units_per_chunk : n_units;
+                for (int64_t u = chunk * units_per_chunk; u < end; u++) {
+                    double ys[2];
+                    double inputs[2][MAX_SENSITIVITY_INPUTS];
+                    uint64_t unit_seed = finisterrae.antithetic ? mix_seed(xorshift64(&seed)) : 0;
+                    for (int k = 0; k < unit_size; k++) {
+                        uint64_t pair_seed = unit_seed;
+                        uint64_t* sample_seed = finisterrae.antithetic ? &pair_seed : &seed;
+                        set_antithetic(k == 1);
+                        if (model != NULL) {
+                            model->sample_inputs(inputs[k], sample_seed);
+                            ys[k] = model->evaluate(inputs[k]);
+                        } else {
+                            ys[k] = finisterrae.sampler(sample_seed);
+                        }
+                        xs[u * unit_size + k] = ys[k];
+                    }
+                    set_antithetic(0);
+                    variance_reduction_add(chunk_stats, ys, inputs);
+                }
+            }
+            n_variance_reduction_chunks = n_unit_chunks;
+            uint64_t leftover_seed = chunk_seed(&sampling_task, n_chunks);
+            for (int64_t j = n_units * unit_size; j < n_samples; j++) {
+                xs[j] = finisterrae.sampler(&leftover_seed);
+            }
+        } else if (use_work_stealing) {
+            work_pool_run(work_pool, n_samples, SAMPLING_CHUNK_SIZE, sample_chunk, &sampling_task);
+        } else if (finisterrae.n_variants == 0) {
+            #pragma omp parallel for
+            for (int64_t chunk = 0; chunk < n_chunks; chunk++) {
+                int64_t end = (chunk + 1) * SAMPLING_CHUNK_SIZE < n_samples ? (chunk + 1) * SAMPLING_CHUNK_SIZE : n_samples;
+                sample_chunk(chunk * SAMPLING_CHUNK_SIZE, end, chunk, &sampling_task);
+            }
+        } else {
+            #pragma omp parallel for
+            for (int64_t chunk = 0; chunk < n_chunks; chunk++) {
+                uint64_t seed = chunk_seed(&sampling_task, chunk);
+                int64_t end = (chunk + 1) * SAMPLING_CHUNK_SIZE < n_samples ? (chunk + 1) * SAMPLING_CHUNK_SIZE : n_samples;
+                for (int64_t j = chunk * SAMPLING_CHUNK_SIZE; j < end; j++) {
+                    // With common random numbers, every variant starts this sample from the same seed,
+                    // so inputs that variants share get the same draws. Models split into inputs only draw them once.
+                    uint64_t sample_seed = finisterrae.common_random_numbers ? mix_seed(xorshift64(&seed)) : 0;
+                    const Sensitivity_model* drawn_model = NULL;
+                    double inputs[MAX_SENSITIVITY_INPUTS];
+                    for (int v = 0; v < n_variants; v++) {
+                        uint64_t variant_seed = sample_seed;
+                        uint64_t* draw_seed = finisterrae.common_random_numbers ? &variant_seed : &seed;
+                        int inputs_drawn = finisterrae.common_random_numbers && variants[v].model != NULL && variants[v].model == drawn_model;
+                        variant_xs[v][j] = sample_variant(&variants[v], inputs, inputs_drawn, draw_seed);
+                        drawn_model = variants[v].model;
+                    }
+                }
+            }
         }
-        Outliers individual_mpi_histogram_outliers = { .os = os, .n = 0, .capacity = 100 };
-        individual_mpi_process_stats = (Summary_stats) {
-            .n_samples = n_samples,
-            .min = xs[0],
-            .max = xs[0],
-            .mean = 0.0,
-            .variance = 0.0,
-            .histogram = individual_mpi_process_histogram,
-            .outliers = individual_mpi_histogram_outliers,
-        };
+        sampling_task.first_chunk += n_chunk_slots;
+        phase_times.sampling += omp_get_wtime() - phase_start;
+        phase_start = omp_get_wtime();
+#ifdef SQUIGGLE_INSTRUMENT
+        n_sampler_calls += (uint64_t)n_samples * (uint64_t)n_variants;
+#endif
 
-        // One serial loop for mean, min, max & histogram
-        // Possibly, these could be done more efficiently with openmp reductions,
-        // but I don't quite understand them
-
-        double mean = 0.0;
-        double min = DBL_MAX; // Use float.h's DBL_MAX for initialization
-        double max = -DBL_MAX;
-
-	#pragma omp parallel for reduction (+ : mean) reduction(min : min) reduction(max : max) 
-        for (int k = 0; k < n_samples; k++) {
-            mean += xs[k];
-            if (min > xs[k]) min = xs[k];
-            if (max < xs[k]) max = xs[k];
-        }
-	for (int k=0; k < n_samples; k++) { // do this serially to avoid race conditions
-	    if (COLLECT_OUTLIERS && (xs[k] < individual_mpi_process_stats.histogram.min || xs[k] >= individual_mpi_process_stats.histogram.sup)) {
-                if (individual_mpi_process_stats.outliers.n >= individual_mpi_process_stats.outliers.capacity) {
-                    int new_capacity = individual_mpi_process_stats.outliers.capacity * 2;
-                    double* new_os = (double*)realloc(individual_mpi_process_stats.outliers.os, new_capacity * sizeof(double));
-                    if (new_os == NULL) {
-                        printf("Memory reallocation for outliers failed\n");
-                        return 1;
+        for (int v = 0; v < n_variants; v++) {
+            // Initialize individual process stats struct, reusing its histogram and outliers buffers
+            Histogram individual_mpi_process_histogram = individual_mpi_process_stats[v].histogram;
+            histogram_clear(&individual_mpi_process_histogram);
+            Outliers individual_mpi_histogram_outliers = individual_mpi_process_stats[v].outliers; // buffer grown by previous iterations, if any
+            individual_mpi_histogram_outliers.n = 0;
+            individual_mpi_process_stats[v] = (Summary_stats) {
+                .n_samples = n_samples,
+                .min = variant_xs[v][0],
+                .max = variant_xs[v][0],
+                .mean = 0.0,
+                .variance = 0.0,
+                .shift = shifts[v],
+                .power_sums = { exact_sum_init(), exact_sum_init(), exact_sum_init(), exact_sum_init() },
+                .histogram = individual_mpi_process_histogram,
+                .outliers = individual_mpi_histogram_outliers,
+                .sensitivity = sensitivity_stats_init(v == 0 ? finisterrae.sensitivity_model : NULL, shifts[v]),
+                .tail = tail_stats_init(),
+                .variance_reduction = variance_reduction_stats_init(finisterrae.control_variate_model, finisterrae.antithetic ? 2 : 1, shifts[v]),
+            };
+
+            // One parallel loop for the moments, min & max, and one serial loop for the histogram
+            reduce_samples_moments(variant_xs[v], n_samples, shifts[v], individual_mpi_process_stats[v].power_sums, &individual_mpi_process_stats[v].min, &individual_mpi_process_stats[v].max);
+            moments_from_power_sums(&individual_mpi_process_stats[v]);
+            for (int64_t k = 0; k < n_samples; k++) { // do this serially to avoid race conditions
+                if (COLLECT_OUTLIERS && (variant_xs[v][k] < individual_mpi_process_stats[v].histogram.min || variant_xs[v][k] >= individual_mpi_process_stats[v].histogram.sup)) {
+                    if (individual_mpi_process_stats[v].outliers.n >= individual_mpi_process_stats[v].outliers.capacity) {
+                        int new_capacity = individual_mpi_process_stats[v].outliers.capacity * 2;
+                        double* new_os = (double*)realloc(individual_mpi_process_stats[v].outliers.os, new_capacity * sizeof(double));
+                        if (new_os == NULL) {
+                            printf("Memory reallocation for outliers failed\n");
+                            return 1;
+                        }
+                        individual_mpi_process_stats[v].outliers.os = new_os;
+                        individual_mpi_process_stats[v].outliers.capacity = new_capacity;
                     }
-                    individual_mpi_process_stats.outliers.os = new_os;
-                    individual_mpi_process_stats.outliers.capacity = new_capacity;
+                    individual_mpi_process_stats[v].outliers.os[individual_mpi_process_stats[v].outliers.n] = variant_xs[v][k];
+                    individual_mpi_process_stats[v].outliers.n++;
+                } else {
+                    double bin_double = (variant_xs[v][k] - individual_mpi_process_stats[v].histogram.min) / individual_mpi_process_stats[v].histogram.bin_width;
+                    if (isnan(bin_double)) continue;
+                    // Clamped to the bins just outside the histogram, which histogram_add drops, so that the cast to int is defined
+                    double n_bins = (double)individual_mpi_process_stats[v].histogram.n_bins;
+                    bin_double = bin_double < -1.0 ? -1.0 : (bin_double > n_bins ? n_bins : bin_double);
+                    int bin_int = (int)floor(bin_double);
+                    histogram_add(&individual_mpi_process_stats[v].histogram, bin_int, 1);
                 }
-                individual_mpi_process_stats.outliers.os[individual_mpi_process_stats.outliers.n] = xs[k];
-                individual_mpi_process_stats.outliers.n++;
-            } else {
-                double bin_double = (xs[k] - individual_mpi_process_stats.histogram.min) / individual_mpi_process_stats.histogram.bin_width;
-                int bin_int = (int)floor(bin_double);
-                individual_mpi_process_stats.histogram.bins[bin_int]++;
+            }
+            // And one for the largest samples, for the tail fit
+            reduce_samples_tail(variant_xs[v], n_samples, &individual_mpi_process_stats[v].tail);
+            if (v > 0) {
+                individual_mpi_process_stats[v].difference_shift = shifts[v] - shifts[0];
+                reduce_samples_difference(variant_xs[v], variant_xs[0], n_samples, individual_mpi_process_stats[v].difference_shift, individual_mpi_process_stats[v].difference_sums);
+                individual_mpi_process_stats[v].n_differences = n_samples;
+            }
+        }
+
+        convergence_add_chunk(&convergence, xs, n_samples);
+
+        if (use_variance_reduction) {
+            for (int64_t chunk = 0; chunk < n_variance_reduction_chunks; chunk++) {
+                variance_reduction_merge(&individual_mpi_process_stats[0].variance_reduction, &variance_reduction_chunk_stats[chunk]);
             }
         }
-        individual_mpi_process_stats.mean = mean / n_samples;
-	    individual_mpi_process_stats.min = min;
-	    individual_mpi_process_stats.max = max;
-        // One parallel loop for variance
-        double var = 0.0;
-        #pragma omp parallel for simd reduction(+ : var) // unclear if the for simd reduction applies after we've added other items to the for loop
-        for (int m = 0; m < n_samples; m++) {
-            var += (xs[m] - individual_mpi_process_stats.mean) * (xs[m] - individual_mpi_process_stats.mean);
+
+        // Pick-freeze samples for the sensitivity analysis, into per-thread accumulators.
+        // Seeded per chunk, and summed exactly, so that the indices don't depend on which thread gets which chunk
+        if (finisterrae.sensitivity_model != NULL) {
+            for (int thread_id = 0; thread_id < n_threads; thread_id++) {
+                sensitivity_thread_stats[thread_id] = sensitivity_stats_init(finisterrae.sensitivity_model, shifts[0]);
+            }
+            #pragma omp parallel for
+            for (int64_t chunk = 0; chunk < n_sensitivity_chunks; chunk++) {
+                int thread_id = omp_get_thread_num();
+                uint64_t seed = chunk_seed(&sensitivity_task, chunk);
+                int64_t end = (chunk + 1) * SENSITIVITY_CHUNK_SIZE < n_sensitivity_samples ? (chunk + 1) * SENSITIVITY_CHUNK_SIZE : n_sensitivity_samples;
+                for (int64_t j = chunk * SENSITIVITY_CHUNK_SIZE; j < end; j++) {
+                    sensitivity_accumulate(&sensitivity_thread_stats[thread_id], &seed);
+                }
+            }
+            sensitivity_task.first_chunk += (uint64_t)n_sensitivity_chunks;
+            for (int thread_id = 0; thread_id < n_threads; thread_id++) {
+                sensitivity_merge(&individual_mpi_process_stats[0].sensitivity, &sensitivity_thread_stats[thread_id]);
+            }
         }
-        individual_mpi_process_stats.variance = var / n_samples;
 
         /*
         for (int i=0; i<n_processes; i++){
@@ -305,55 +1414,188 @@ int sampler_finisterrae(Finisterrae_params finisterrae)
         }
         */
 
+        phase_times.statistics += omp_get_wtime() - phase_start;
+        phase_start = omp_get_wtime();
+
         IF_MPI(MPI_Barrier(MPI_COMM_WORLD));
-        IF_MPI(MPI_Gather(&individual_mpi_process_stats, sizeof(Summary_stats), MPI_CHAR, mpi_processes_stats_array, sizeof(Summary_stats), MPI_CHAR, 0, MPI_COMM_WORLD));
-        IF_MPI(MPI_Gather(individual_mpi_process_stats.histogram.bins, finisterrae.histogram_n_bins * sizeof(uint64_t), MPI_CHAR, all_bins, finisterrae.histogram_n_bins * sizeof(uint64_t), MPI_CHAR, 0, MPI_COMM_WORLD));
+        // What each rank sends to rank 0: its own stats, or with node aggregation, its node's, from leaders only
+        Summary_stats* sent_stats = individual_mpi_process_stats;
+        Convergence* sent_convergence = &convergence;
+        int n_sources = n_processes;
+        IF_MPI(MPI_Comm gather_comm = MPI_COMM_WORLD);
+#ifndef NO_MPI
+        if (finisterrae.node_aggregation) {
+            node_aggregate(&node, individual_mpi_process_stats, &convergence, n_variants);
+            sent_stats = node.merged_stats;
+            sent_convergence = &node.merged_convergence;
+            n_sources = node.n_nodes;
+            gather_comm = node.leaders_comm;
+        }
+#endif
+        // Gather into a free report slot; process 0 only waits here if the reporter is N_REPORT_SLOTS iterations behind
+        Report* report = mpi_id == 0 ? (Report*)reporter_acquire(&reporter) : NULL;
+        if (report != NULL) report->process_histograms.size = 0;
+        for (int v = 0; v < n_variants; v++) {
+            Summary_stats* process_stats = report != NULL ? report->process_stats + (size_t)v * n_sources : NULL;
+            int* histogram_sizes = report != NULL ? report->histogram_sizes + (size_t)v * n_sources : NULL;
+            int* histogram_offsets = report != NULL ? report->histogram_offsets + (size_t)v * n_sources : NULL;
+            IF_MPI(if (gather_comm != MPI_COMM_NULL) MPI_Gather(&sent_stats[v], sizeof(Summary_stats), MPI_CHAR, process_stats, sizeof(Summary_stats), MPI_CHAR, 0, gather_comm));
+            IF_MPI(if (gather_comm != MPI_COMM_NULL) gather_histograms(&sent_stats[v].histogram, &histogram_buffer, report != NULL ? &report->process_histograms : NULL, histogram_sizes, histogram_offsets, gather_comm));
 
-        IF_NO_MPI(mpi_processes_stats_array[0] = individual_mpi_process_stats);
+            IF_NO_MPI(process_stats[0] = sent_stats[v]);
+#ifdef NO_MPI
+            byte_buffer_reserve(&report->process_histograms, report->process_histograms.size + histogram_serialized_size_bound(&sent_stats[v].histogram));
+            histogram_offsets[0] = (int)report->process_histograms.size;
+            histogram_sizes[0] = (int)histogram_serialize(&sent_stats[v].histogram, report->process_histograms.bytes + report->process_histograms.size);
+            report->process_histograms.size += (size_t)histogram_sizes[0];
+#endif
+        }
+        IF_MPI(if (gather_comm != MPI_COMM_NULL) MPI_Gather(sent_convergence, sizeof(Convergence), MPI_CHAR, report != NULL ? report->process_convergences : NULL, sizeof(Convergence), MPI_CHAR, 0, gather_comm));
+        IF_NO_MPI(report->process_convergences[0] = *sent_convergence);
+        double peak_rss = peak_rss_gigabytes();
+        IF_MPI(MPI_Reduce(mpi_id == 0 ? MPI_IN_PLACE : &peak_rss, &peak_rss, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD));
+        if (report != NULL) {
+            report->iteration = i;
+            report->peak_rss = peak_rss;
+            report->n_sources = n_sources;
+            reporter_publish(&reporter);
+        }
+        phase_times.gather += omp_get_wtime() - phase_start;
+        n_samples_drawn += (uint64_t)n_samples;
+    }
+#ifndef NO_MPI
+    if (finisterrae.node_aggregation) node_aggregation_free(&node, n_variants);
+#endif
+    free(sensitivity_thread_stats);
+    free(variance_reduction_chunk_stats);
+    free(jumps);
+    free(xs_arena);
+    if (work_pool != NULL) {
+        work_pool_destroy(work_pool);
+    }
+    free(shifts);
+    free(variant_xs);
+    free(histogram_buffer.bytes);
+    for (int v = 0; v < n_variants; v++) {
+        histogram_free(&individual_mpi_process_stats[v].histogram);
+        free(individual_mpi_process_stats[v].outliers.os);
+    }
 
-        if (mpi_id == 0) {
-            for (int p = 0; p < n_processes; p++) {
-                IF_MPI(mpi_processes_stats_array[p].histogram.bins = all_bins + p * finisterrae.histogram_n_bins);
-                // print_stats(mpi_processes_stats_array+p);
-            }
-            reduce_chunk_stats(&aggregated_mpi_processes_stats, mpi_processes_stats_array, n_processes);
-            if (i % finisterrae.print_every_n_iters == 0) {
-                printf("\nIter %3ld:\n", i);
-                print_stats(&aggregated_mpi_processes_stats);
+    if (mpi_id == 0) {
+        reporter_stop(&reporter);
+        for (int r = 0; r < N_REPORT_SLOTS; r++) {
+            free(reports[r].process_stats);
+            free(reports[r].process_histograms.bytes);
+            free(reports[r].histogram_sizes);
+            free(reports[r].histogram_offsets);
+            free(reports[r].process_convergences);
+        }
+        for (int v = 0; v < n_variants; v++) {
+            if (variants[v].name != NULL) {
+                printf("\nLast iter, %s:\n", variants[v].name);
+            } else {
+                printf("\nLast iter:\n");
             }
+            print_stats(&aggregated_mpi_processes_stats[v]);
+        }
+        print_convergence(report_context.process_convergences, report_context.n_sources);
+        if (use_shards && write_shard_file(&finisterrae, aggregated_mpi_processes_stats, n_variants, report_context.process_convergences, report_context.n_sources) != 0) {
+            fprintf(stderr, "Could not write shard file %s\n", finisterrae.shard_file);
+            exit_code = 1;
         }
     }
-    free(cache_box); // should never be reached, really
-    free(all_bins);
-
-	if (mpi_id == 0) {
-		printf("\nLast iter:\n");
-		print_stats(&aggregated_mpi_processes_stats);
-	}
+    free(report_context.process_convergences);
+    phase_times.total = omp_get_wtime() - start_time;
+#ifdef SQUIGGLE_INSTRUMENT
+    print_squiggle_counters(mpi_id, n_threads, phase_times.sampling, n_sampler_calls);
+#endif
+    print_phase_times(&phase_times, mpi_id, n_samples_drawn);
 
-	return 0;
+    return exit_code;
 }
 
 int main(int argc, char** argv)
 {
-    sampler_finisterrae((Finisterrae_params) {
-        .sampler = sample_cost_effectiveness_sentinel_bps_per_million,
-        .n_samples_per_process = (uint64_t)1 * BILLION,
-        .n_samples_total = (uint64_t)1 * TRILLION,
+    // Daemon mode, for interactive sample sizes: ./samples --serve /tmp/finisterrae.sock [result cache directory], see service.h for the protocol
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--serve") == 0) {
+        Service_model service_models[] = {
+            { .id = "sentinel", .sampler = sample_cost_effectiveness_sentinel_bps_per_million, .model = &sentinel_sensitivity_model },
+            { .id = "sentinel_fused", .sampler = sample_cost_effectiveness_sentinel_bps_per_million_fused },
+        };
+        return serve(argv[2], service_models, sizeof(service_models) / sizeof(service_models[0]), argc == 4 ? argv[3] : NULL);
+    }
+    // Shard mode: ./samples --shard <index> <count> <file>, e.g., as a task of a job array (see launch_shards.sh),
+    // and then ./samples --merge <files>... to combine the shards' files, which doesn't need MPI
+    uint64_t shard_index = 0, shard_count = 0;
+    const char* shard_file = NULL;
+    if (argc == 5 && strcmp(argv[1], "--shard") == 0) {
+        shard_index = strtoull(argv[2], NULL, 10);
+        shard_count = strtoull(argv[3], NULL, 10);
+        shard_file = argv[4];
+        if (shard_count == 0 || shard_index >= shard_count) {
+            fprintf(stderr, "Usage: %s --shard <index> <count> <file>, with 0 <= index < count\n", argv[0]);
+            return 1;
+        }
+    }
+    Finisterrae_params finisterrae = {
+        .sampler = sample_cost_effectiveness_sentinel_bps_per_million, // or sample_cost_effectiveness_sentinel_bps_per_million_fused: same distribution, fewer draws
+        // .batch_sampler = sample_cost_effectiveness_sentinel_bps_per_million_batch, // columnar version, see benchmarks/batch.c
+        .n_samples_per_process = (uint64_t)N_SAMPLES_PER_PROCESS,
+        .n_samples_total = (uint64_t)N_SAMPLES_TOTAL,
         .histogram_min = 0,
         .histogram_sup = 300,
         .histogram_bin_width = 1,
         .histogram_n_bins = 300,
         .print_every_n_iters = 20,
-    });
+        // .sensitivity_model = &sentinel_sensitivity_model,
+        // .sensitivity_n_samples_per_process = (uint64_t)N_SAMPLES_PER_PROCESS / 1000, // Sobol indices, for ~1% extra model evaluations
+        // .status_file = "status.json", // live progress, e.g., with watch cat status.json
+        // .backend = BACKEND_WORK_STEALING, // see benchmarks/scheduling.c
+        .shard_index = shard_index,
+        .shard_count = shard_count,
+        .shard_file = shard_file,
+    };
+    if (argc >= 3 && strcmp(argv[1], "--merge") == 0) {
+        return merge_shard_files(finisterrae, argv + 2, argc - 2);
+    }
+#ifndef NO_MPI
+    // Process 0 runs a reporter thread next to the main one, and OpenMP threads sample, but only the main thread calls MPI
+    int mpi_thread_level;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &mpi_thread_level);
+    if (mpi_thread_level < MPI_THREAD_FUNNELED) {
+        fprintf(stderr, "This MPI library doesn't support threads (MPI_THREAD_FUNNELED).\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+#endif
+    int result = sampler_finisterrae(finisterrae);
     // Two types of histogram:
     // 1. Exploring the main part of the distribution
     // 2. Exploring the long tail.
     // We are interested in both, but for the 1T samples we are interested in the long tail
+    /* For several values of catastrophic_to_existential_conversion_factor in the same pass, with common random numbers:
+    Finisterrae_variant conversion_factors[] = {
+        { .name = "conversion factor 10", .model = &sentinel_sensitivity_model, .fixed_input = CATASTROPHIC_TO_EXISTENTIAL_CONVERSION_FACTOR, .fixed_value = 10 },
+        { .name = "conversion factor 100", .model = &sentinel_sensitivity_model, .fixed_input = CATASTROPHIC_TO_EXISTENTIAL_CONVERSION_FACTOR, .fixed_value = 100 },
+        { .name = "conversion factor 1000", .model = &sentinel_sensitivity_model, .fixed_input = CATASTROPHIC_TO_EXISTENTIAL_CONVERSION_FACTOR, .fixed_value = 1000 },
+    };
+    sampler_finisterrae((Finisterrae_params) {
+        .variants = conversion_factors,
+        .n_variants = 3,
+        .common_random_numbers = 1,
+        .n_samples_per_process = N_SAMPLES_PER_PROCESS,
+        .n_samples_total = N_SAMPLES_TOTAL,
+        .histogram_min = 0,
+        .histogram_sup = 300,
+        .histogram_bin_width = 1,
+        .histogram_n_bins = 300,
+        .print_every_n_iters = 20,
+    });
+    */
     /* For main part of the distribution:
     sampler_finisterrae((Finisterrae_params) {
         .sampler = sample_cost_effectiveness_sentinel_bps_per_million,
         .n_samples_per_process = N_SAMPLES_PER_PROCESS,
+        .n_samples_total = N_SAMPLES_TOTAL,
         .histogram_min = 0,
         .histogram_sup = 1,
         .histogram_bin_width = 0.01,
@@ -361,5 +1603,6 @@ int main(int argc, char** argv)
         .print_every_n_iters = 10,
     });
     */
-    return 0;
+    IF_MPI(MPI_Finalize());
+    return result;
 }
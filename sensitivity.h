@@ -0,0 +1,42 @@
+#ifndef FINISTERRAE_SENSITIVITY
+#define FINISTERRAE_SENSITIVITY
+
+#include <stdint.h>
+
+#include "exact_sum.h"
+
+/* Variance decomposition (Sobol indices) of a model's inputs */
+
+// Fixed size, so that stats can be gathered over MPI as a flat struct
+#define MAX_SENSITIVITY_INPUTS 16
+
+/* A model split into drawing its inputs and evaluating them */
+typedef struct _Sensitivity_model {
+    int n_inputs;
+    const char* const* input_names;
+    void (*sample_inputs)(double* inputs, uint64_t* seed);
+    double (*evaluate)(double* inputs);
+    const double* input_means; // optional: analytic means, NAN for inputs without one; used as control variates
+} Sensitivity_model;
+
+/* Streaming, mergeable sums for the pick-freeze estimators. Exact (see exact_sum.h), so that merges don't depend on the order of threads, processes or nodes */
+typedef struct _Sensitivity_stats {
+    const Sensitivity_model* model; // local to each process, not merged
+    uint64_t n_samples;
+    // Sums of f - shift and its square, for the output variance. The shift is the same for every process and iteration,
+    // and close to the mean, so that the variance doesn't come from subtracting two large, nearly equal sums
+    double shift;
+    Exact_sum sum_f_a;
+    Exact_sum sum_f_a_squared;
+    Exact_sum sum_f_b;
+    Exact_sum sum_f_b_squared;
+    Exact_sum sum_first_order[MAX_SENSITIVITY_INPUTS]; // sum of f(B) * (f(A_B^i) - f(A))
+    Exact_sum sum_total_order[MAX_SENSITIVITY_INPUTS]; // sum of (f(A) - f(A_B^i))^2
+} Sensitivity_stats;
+
+Sensitivity_stats sensitivity_stats_init(const Sensitivity_model* model, double shift);
+void sensitivity_accumulate(Sensitivity_stats* stats, uint64_t* seed);
+void sensitivity_merge(Sensitivity_stats* accumulator, Sensitivity_stats* new);
+void print_sensitivity(Sensitivity_stats* stats);
+
+#endif
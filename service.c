@@ -0,0 +1,460 @@
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <omp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "result_cache.h"
+#include "service.h"
+#include "squiggle_c/squiggle.h"
+#include "squiggle_c/squiggle_more.h"
+
+#define SERVICE_LINE_LENGTH 4096
+#define SERVICE_HISTOGRAM_LINE_LENGTH (256 + (size_t)SERVICE_MAX_BINS * 21) // a count has at most 20 digits, then a comma
+#define SERVICE_RNG_SCHEME "xorshift64/splitmix64-per-thread/v1" // change if how seeds are derived or advanced changes
+#ifndef MODEL_CODE_HASH
+#define MODEL_CODE_HASH "unknown" // the makefile passes a checksum of the model's sources
+#endif
+
+/* What stays warm between jobs: the threads, their seeds, and the buffers, with their pages already faulted in */
+typedef struct _Service_pool {
+    int n_threads;
+    seed_cache_box* seeds;
+    double* xs;
+    uint64_t* bins;
+    uint64_t* thread_bins; // SERVICE_MAX_BINS per thread, merged into bins after each chunk
+    char* histogram_line; // the histogram message, formatted before it is sent in one write
+    const char* cache_directory; // NULL if results aren't cached
+    Cached_result* cached;
+} Service_pool;
+
+typedef struct _Service_job {
+    const Service_model* model;
+    uint64_t n_samples;
+    uint64_t seed;
+    int n_bins; // 0 if no histogram was asked for
+    double histogram_min;
+    double histogram_sup;
+    int n_fixed;
+    int fixed_inputs[MAX_SENSITIVITY_INPUTS];
+    double fixed_values[MAX_SENSITIVITY_INPUTS];
+} Service_job;
+
+typedef struct _Service_stats {
+    uint64_t n_samples;
+    double mean;
+    double m2;
+    double min;
+    double max;
+    uint64_t below; // histogram underflow and overflow
+    uint64_t above;
+} Service_stats;
+
+/* Connections: line buffered, so that a "cancel" can be picked out while a job runs */
+typedef struct _Connection {
+    int fd;
+    int length;
+    char buffer[SERVICE_LINE_LENGTH];
+} Connection;
+
+static int take_line(Connection* connection, char* line, int skip_unless_cancel)
+{
+    // Takes the first complete line out of the buffer. While a job runs, only "cancel" is taken; the rest waits for later
+    int start = 0;
+    while (start < connection->length) {
+        char* newline = memchr(connection->buffer + start, '\n', (size_t)(connection->length - start));
+        if (newline == NULL) break;
+        int end = (int)(newline - connection->buffer);
+        int line_length = end - start;
+        if (line_length > 0 && connection->buffer[end - 1] == '\r') line_length--;
+        int is_cancel = line_length == 6 && strncmp(connection->buffer + start, "cancel", 6) == 0;
+        if (!skip_unless_cancel || is_cancel) {
+            if (line != NULL) {
+                memcpy(line, connection->buffer + start, (size_t)line_length);
+                line[line_length] = '\0';
+            }
+            memmove(connection->buffer + start, newline + 1, (size_t)(connection->length - end - 1));
+            connection->length -= end + 1 - start;
+            return 1;
+        }
+        start = end + 1;
+    }
+    return 0;
+}
+
+static int receive(Connection* connection)
+{
+    if (connection->length == SERVICE_LINE_LENGTH) connection->length = 0; // a line too long to be a job; drop it
+    ssize_t n_received = recv(connection->fd, connection->buffer + connection->length, (size_t)(SERVICE_LINE_LENGTH - connection->length), 0);
+    if (n_received <= 0) return 0;
+    connection->length += (int)n_received;
+    return 1;
+}
+
+static int read_line(Connection* connection, char* line)
+{
+    while (!take_line(connection, line, 0)) {
+        if (!receive(connection)) return 0;
+    }
+    return 1;
+}
+
+static int cancel_requested(Connection* connection)
+{
+    struct pollfd poll_fd = { .fd = connection->fd, .events = POLLIN };
+    while (poll(&poll_fd, 1, 0) > 0) {
+        if (!receive(connection)) return 1; // closed by the client
+    }
+    return take_line(connection, NULL, 1);
+}
+
+/* Jobs */
+static int parse_count(const char* value, uint64_t* count)
+{
+    // Digits, optionally followed by a power of ten, so that 1e9 works too. Returns 1 unless it's exactly a count in [1, 2^64)
+    if (*value < '0' || *value > '9') return 1; // strtoull would take a sign, or spaces
+    char* end;
+    errno = 0;
+    uint64_t n = strtoull(value, &end, 10);
+    if (errno == ERANGE) return 1;
+    if (*end == 'e' || *end == 'E') {
+        const char* exponent = end + 1;
+        if (*exponent < '0' || *exponent > '9') return 1;
+        uint64_t power = strtoull(exponent, &end, 10);
+        for (uint64_t p = 0; p < power && n > 0; p++) {
+            if (n > UINT64_MAX / 10) return 1;
+            n *= 10;
+        }
+    }
+    if (*end != '\0' || n == 0) return 1;
+    *count = n;
+    return 0;
+}
+
+static int parse_job(char* line, const Service_model* models, int n_models, Service_job* job, char* error)
+{
+    memset(job, 0, sizeof(Service_job));
+    job->seed = 1;
+    char* saveptr;
+    for (char* token = strtok_r(line, " \t", &saveptr); token != NULL; token = strtok_r(NULL, " \t", &saveptr)) {
+        char* value = strchr(token, '=');
+        if (value == NULL) {
+            snprintf(error, SERVICE_LINE_LENGTH, "expected key=value, got %s", token);
+            return 1;
+        }
+        *value++ = '\0';
+        if (strcmp(token, "model") == 0) {
+            for (int m = 0; m < n_models; m++) {
+                if (strcmp(models[m].id, value) == 0) job->model = &models[m];
+            }
+            if (job->model == NULL) {
+                snprintf(error, SERVICE_LINE_LENGTH, "unknown model %s", value);
+                return 1;
+            }
+        } else if (strcmp(token, "n") == 0) {
+            if (parse_count(value, &job->n_samples)) {
+                snprintf(error, SERVICE_LINE_LENGTH, "n should be a positive integer below 2^64, e.g., 1000000 or 1e6, got %s", value);
+                return 1;
+            }
+        } else if (strcmp(token, "seed") == 0) {
+            job->seed = strtoull(value, NULL, 10);
+        } else if (strcmp(token, "histogram") == 0) {
+            if (sscanf(value, "%lf,%lf,%d", &job->histogram_min, &job->histogram_sup, &job->n_bins) != 3 || job->n_bins <= 0 || job->n_bins > SERVICE_MAX_BINS || !(job->histogram_sup > job->histogram_min)) {
+                snprintf(error, SERVICE_LINE_LENGTH, "histogram should be <min>,<sup>,<n_bins>, with at most %d bins", SERVICE_MAX_BINS);
+                return 1;
+            }
+        } else {
+            // Any other key is an input of the model, to be fixed at that value
+            const Sensitivity_model* model = job->model != NULL ? job->model->model : NULL;
+            int input = -1;
+            for (int i = 0; model != NULL && i < model->n_inputs; i++) {
+                if (strcmp(model->input_names[i], token) == 0) input = i;
+            }
+            if (input < 0 || job->n_fixed == MAX_SENSITIVITY_INPUTS) {
+                snprintf(error, SERVICE_LINE_LENGTH, "unknown key %s (inputs go after model=, and only for models split into inputs)", token);
+                return 1;
+            }
+            job->fixed_inputs[job->n_fixed] = input;
+            job->fixed_values[job->n_fixed] = strtod(value, NULL);
+            job->n_fixed++;
+        }
+    }
+    if (job->model == NULL || job->n_samples == 0) {
+        snprintf(error, SERVICE_LINE_LENGTH, "a job needs at least model= and n=");
+        return 1;
+    }
+    return 0;
+}
+
+static double sample_job(const Service_job* job, double* inputs, uint64_t* seed)
+{
+    const Sensitivity_model* model = job->model->model;
+    if (job->n_fixed == 0 || model == NULL) {
+        return job->model->sampler(seed);
+    }
+    model->sample_inputs(inputs, seed);
+    for (int f = 0; f < job->n_fixed; f++) {
+        inputs[job->fixed_inputs[f]] = job->fixed_values[f];
+    }
+    return model->evaluate(inputs);
+}
+
+static void add_chunk(Service_stats* stats, double* xs, int64_t n)
+{
+    double sum = 0.0;
+    double min = DBL_MAX;
+    double max = -DBL_MAX;
+    #pragma omp parallel for reduction(+ : sum) reduction(min : min) reduction(max : max)
+    for (int64_t k = 0; k < n; k++) {
+        sum += xs[k];
+        if (min > xs[k]) min = xs[k];
+        if (max < xs[k]) max = xs[k];
+    }
+    double mean = sum / n;
+    double m2 = 0.0;
+    #pragma omp parallel for simd reduction(+ : m2)
+    for (int64_t k = 0; k < n; k++) {
+        m2 += (xs[k] - mean) * (xs[k] - mean);
+    }
+    // Merge, as in combine_variances
+    uint64_t n_total = stats->n_samples + (uint64_t)n;
+    double delta = mean - stats->mean;
+    stats->mean += delta * (double)n / (double)n_total;
+    stats->m2 += m2 + delta * delta * (double)stats->n_samples * (double)n / (double)n_total;
+    stats->n_samples = n_total;
+    if (stats->min > min) stats->min = min;
+    if (stats->max < max) stats->max = max;
+}
+
+static void add_chunk_to_histogram(const Service_job* job, Service_pool* pool, Service_stats* stats, double* xs, int64_t n)
+{
+    double bin_width = (job->histogram_sup - job->histogram_min) / job->n_bins;
+    int n_bins = job->n_bins;
+    uint64_t below = 0, above = 0;
+    // Each thread counts into its own bins, which are then summed bin by bin
+    #pragma omp parallel reduction(+ : below, above)
+    {
+        uint64_t* bins = pool->thread_bins + (size_t)omp_get_thread_num() * SERVICE_MAX_BINS;
+        memset(bins, 0, (size_t)n_bins * sizeof(uint64_t));
+        #pragma omp for schedule(static)
+        for (int64_t k = 0; k < n; k++) {
+            if (isnan(xs[k])) continue; // in neither the bins nor the counts below and above
+            if (xs[k] < job->histogram_min) {
+                below++;
+            } else if (xs[k] >= job->histogram_sup) {
+                above++;
+            } else {
+                // Rounding can put samples just below sup at n_bins
+                int bin = (int)floor((xs[k] - job->histogram_min) / bin_width);
+                bins[bin < 0 ? 0 : (bin >= n_bins ? n_bins - 1 : bin)]++;
+            }
+        }
+        #pragma omp for schedule(static)
+        for (int b = 0; b < n_bins; b++) {
+            for (int t = 0; t < omp_get_num_threads(); t++) {
+                pool->bins[b] += pool->thread_bins[(size_t)t * SERVICE_MAX_BINS + (size_t)b];
+            }
+        }
+    }
+    stats->below += below;
+    stats->above += above;
+}
+
+static int write_all(int fd, const char* buffer, size_t size)
+{
+    while (size > 0) {
+        ssize_t n_written = write(fd, buffer, size);
+        if (n_written < 0 && errno == EINTR) continue;
+        if (n_written <= 0) return 1;
+        buffer += n_written;
+        size -= (size_t)n_written;
+    }
+    return 0;
+}
+
+static void send_histogram(int fd, const Service_job* job, Service_pool* pool, Service_stats* stats)
+{
+    char* line = pool->histogram_line;
+    size_t length = (size_t)snprintf(line, SERVICE_HISTOGRAM_LINE_LENGTH, "histogram min=%.12g bin_width=%.12g below=%lu above=%lu bins=", job->histogram_min, (job->histogram_sup - job->histogram_min) / job->n_bins, stats->below, stats->above);
+    for (int b = 0; b < job->n_bins; b++) {
+        length += (size_t)snprintf(line + length, SERVICE_HISTOGRAM_LINE_LENGTH - length, b + 1 < job->n_bins ? "%lu," : "%lu\n", pool->bins[b]);
+    }
+    write_all(fd, line, length);
+}
+
+static int send_stats(int fd, const char* kind, Service_stats* stats)
+{
+    return dprintf(fd, "%s n=%lu mean=%.12g variance=%.12g min=%.12g max=%.12g\n", kind, stats->n_samples, stats->mean, stats->m2 / (double)stats->n_samples, stats->min, stats->max) < 0;
+}
+
+/* Result cache: everything but n determines the samples, so a cached run can be extended by continuing its RNG streams */
+static void describe_job(const Service_job* job, int n_threads, char* description)
+{
+    int length = snprintf(description, RESULT_CACHE_DESCRIPTION_LENGTH, "model=%s code=%s rng=%s threads=%d seed=%lu histogram=%a,%a,%d",
+        job->model->id, MODEL_CODE_HASH, SERVICE_RNG_SCHEME, n_threads, job->seed, job->histogram_min, job->histogram_sup, job->n_bins);
+    // Fixed inputs in input order, with the last value given winning, as in sample_job
+    const Sensitivity_model* model = job->model->model;
+    for (int i = 0; model != NULL && i < model->n_inputs; i++) {
+        int last = -1;
+        for (int f = 0; f < job->n_fixed; f++) {
+            if (job->fixed_inputs[f] == i) last = f;
+        }
+        if (last >= 0 && length < RESULT_CACHE_DESCRIPTION_LENGTH) {
+            length += snprintf(description + length, (size_t)(RESULT_CACHE_DESCRIPTION_LENGTH - length), " %s=%a", model->input_names[i], job->fixed_values[last]);
+        }
+    }
+}
+
+static void save_to_cache(Service_job* job, Service_pool* pool, Service_stats* stats)
+{
+    Cached_result* cached = pool->cached;
+    describe_job(job, pool->n_threads, cached->description);
+    cached->n_samples = stats->n_samples;
+    cached->mean = stats->mean;
+    cached->m2 = stats->m2;
+    cached->min = stats->min;
+    cached->max = stats->max;
+    cached->below = stats->below;
+    cached->above = stats->above;
+    cached->n_bins = job->n_bins;
+    cached->n_threads = pool->n_threads;
+    for (int thread_id = 0; thread_id < pool->n_threads; thread_id++) {
+        cached->seeds[thread_id] = pool->seeds[thread_id].seed;
+    }
+    if (result_cache_save(pool->cache_directory, cached, pool->bins) != 0) {
+        fprintf(stderr, "Could not save result to %s\n", pool->cache_directory);
+    }
+}
+
+static void run_job(Connection* connection, Service_job* job, Service_pool* pool)
+{
+    Service_stats stats = { .n_samples = 0, .mean = 0.0, .m2 = 0.0, .min = DBL_MAX, .max = -DBL_MAX };
+    char description[RESULT_CACHE_DESCRIPTION_LENGTH];
+    describe_job(job, pool->n_threads, description);
+    int resume = pool->cache_directory != NULL && result_cache_load(pool->cache_directory, description, pool->cached, pool->bins) == 0;
+    // Chunks are split between threads the same way every time, so a run continued from a chunk boundary draws the same samples
+    // as a fresh one. From anywhere else it wouldn't, so a cached run that is too short and ends mid-chunk is redone from scratch
+    if (resume && pool->cached->n_samples < job->n_samples && pool->cached->n_samples % SERVICE_CHUNK_SIZE != 0) resume = 0;
+    if (resume) {
+        // Pick up where the cached run left off: its stats, its histogram, and its RNG streams
+        Cached_result* cached = pool->cached;
+        stats = (Service_stats) { .n_samples = cached->n_samples, .mean = cached->mean, .m2 = cached->m2, .min = cached->min, .max = cached->max, .below = cached->below, .above = cached->above };
+        for (int thread_id = 0; thread_id < pool->n_threads; thread_id++) {
+            pool->seeds[thread_id].seed = cached->seeds[thread_id];
+        }
+        dprintf(connection->fd, "cached n=%lu\n", stats.n_samples);
+    } else {
+        for (int thread_id = 0; thread_id < pool->n_threads; thread_id++) {
+            pool->seeds[thread_id].seed = mix_seed(job->seed + (uint64_t)thread_id * 0x9e3779b97f4a7c15ULL) | 1; // xorshift64 needs a nonzero seed
+        }
+        if (job->n_bins > 0) {
+            memset(pool->bins, 0, (size_t)job->n_bins * sizeof(uint64_t));
+        }
+    }
+    uint64_t n_samples_cached = stats.n_samples;
+    while (stats.n_samples < job->n_samples) {
+        if (cancel_requested(connection)) {
+            // What was sampled until now is still a valid run, so keep it
+            if (pool->cache_directory != NULL && stats.n_samples > n_samples_cached) {
+                save_to_cache(job, pool, &stats);
+            }
+            dprintf(connection->fd, "cancelled n=%lu\n", stats.n_samples);
+            return;
+        }
+        int64_t n = (int64_t)(job->n_samples - stats.n_samples) < SERVICE_CHUNK_SIZE ? (int64_t)(job->n_samples - stats.n_samples) : SERVICE_CHUNK_SIZE;
+        #pragma omp parallel
+        {
+            int thread_id = omp_get_thread_num();
+            double inputs[MAX_SENSITIVITY_INPUTS];
+            #pragma omp for schedule(static)
+            for (int64_t j = 0; j < n; j++) {
+                pool->xs[j] = sample_job(job, inputs, &(pool->seeds[thread_id].seed));
+            }
+        }
+        add_chunk(&stats, pool->xs, n);
+        if (job->n_bins > 0) {
+            add_chunk_to_histogram(job, pool, &stats, pool->xs, n);
+        }
+        if (send_stats(connection->fd, "progress", &stats)) break; // the client is gone, but the samples can still be cached
+    }
+    if (pool->cache_directory != NULL && stats.n_samples > n_samples_cached) {
+        save_to_cache(job, pool, &stats);
+    }
+    if (job->n_bins > 0) {
+        send_histogram(connection->fd, job, pool, &stats);
+    }
+    send_stats(connection->fd, "done", &stats);
+}
+
+int serve(const char* socket_path, const Service_model* models, int n_models, const char* cache_directory)
+{
+    signal(SIGPIPE, SIG_IGN); // a client that hangs up shows up as a failed write, not as a dead daemon
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (listener < 0 || strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Could not create socket %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+    unlink(socket_path);
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        fprintf(stderr, "Could not listen on %s: %s\n", socket_path, strerror(errno));
+        return 1;
+    }
+
+    // Warm up: start the threads, and fault in the buffers' pages from the threads that will use them
+    Service_pool pool;
+    pool.n_threads = omp_get_max_threads();
+    pool.seeds = (seed_cache_box*)malloc(sizeof(seed_cache_box) * (size_t)pool.n_threads);
+    pool.xs = (double*)malloc((size_t)SERVICE_CHUNK_SIZE * sizeof(double));
+    pool.bins = (uint64_t*)calloc(SERVICE_MAX_BINS, sizeof(uint64_t));
+    pool.thread_bins = (uint64_t*)malloc((size_t)pool.n_threads * SERVICE_MAX_BINS * sizeof(uint64_t));
+    pool.histogram_line = (char*)malloc(SERVICE_HISTOGRAM_LINE_LENGTH);
+    pool.cache_directory = cache_directory;
+    pool.cached = (Cached_result*)malloc(sizeof(Cached_result));
+    if (strcmp(MODEL_CODE_HASH, "unknown") == 0 && cache_directory != NULL) {
+        fprintf(stderr, "Not caching results: built without MODEL_CODE_HASH, so cached results could be from other versions of the model\n");
+        pool.cache_directory = NULL;
+    }
+    if (pool.n_threads > RESULT_CACHE_MAX_THREADS) {
+        pool.cache_directory = NULL;
+    }
+    if (pool.seeds == NULL || pool.xs == NULL || pool.bins == NULL || pool.thread_bins == NULL || pool.histogram_line == NULL || pool.cached == NULL) {
+        fprintf(stderr, "Memory allocation for the service failed.\n");
+        return 1;
+    }
+    #pragma omp parallel for
+    for (int64_t j = 0; j < SERVICE_CHUNK_SIZE; j++) {
+        pool.xs[j] = 0.0;
+    }
+    printf("Serving on %s with %d threads\n", socket_path, pool.n_threads);
+    fflush(stdout);
+
+    for (;;) {
+        Connection connection = { .fd = accept(listener, NULL, NULL), .length = 0 };
+        if (connection.fd < 0) continue;
+        char line[SERVICE_LINE_LENGTH];
+        char error[SERVICE_LINE_LENGTH];
+        while (read_line(&connection, line)) {
+            if (line[0] == '\0' || strcmp(line, "cancel") == 0) continue; // nothing to cancel between jobs
+            Service_job job;
+            if (parse_job(line, models, n_models, &job, error)) {
+                dprintf(connection.fd, "error %s\n", error);
+                continue;
+            }
+            run_job(&connection, &job, &pool);
+        }
+        close(connection.fd);
+    }
+    return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef FINISTERRAE_SERVICE
+#define FINISTERRAE_SERVICE
+
+#include <stdint.h>
+
+#include "sensitivity.h"
+
+/* Resident sampling service: a daemon that keeps its thread pool and buffers warm, and takes jobs over a Unix domain socket */
+
+/*
+Protocol: one line per message, fields separated by spaces. A client sends a job,
+    model=<id> n=<samples> seed=<seed> [histogram=<min>,<sup>,<n_bins>] [<input name>=<value> ...]
+and gets back, if part of it was cached,
+    cached n=<samples already in the cache>
+then, as the samples come in,
+    progress n=<samples so far> mean=<> variance=<> min=<> max=<>
+then, if it asked for one,
+    histogram min=<> bin_width=<> below=<> above=<> bins=<count>,<count>,...
+and finally one of
+    done n=<> mean=<> variance=<> min=<> max=<>
+    cancelled n=<samples so far>
+    error <message>
+Sending "cancel", or closing the connection, while a job runs stops it after the current chunk.
+With a cache directory, each job's final stats and RNG positions are saved, keyed by everything but n (see result_cache.h).
+Asking again comes back at once, and results may have more samples than asked for. Asking for more samples only draws the missing
+ones if the cached run ended on a chunk boundary, i.e., at a multiple of SERVICE_CHUNK_SIZE samples; otherwise the run is redone.
+A connection can send several jobs one after another; jobs run one at a time, each on all threads.
+For example, with socat:
+    echo "model=sentinel n=100000000 seed=1 catastrophic_to_existential_conversion_factor=100" | socat - UNIX-CONNECT:/tmp/finisterrae.sock
+*/
+
+#define SERVICE_CHUNK_SIZE (10 * 1000 * 1000) // samples between progress messages and cancellation checks
+#define SERVICE_MAX_BINS 100000
+
+typedef struct _Service_model {
+    const char* id;
+    double (*sampler)(uint64_t* seed);
+    const Sensitivity_model* model; // optional: lets jobs fix any of the model's inputs, by name
+} Service_model;
+
+int serve(const char* socket_path, const Service_model* models, int n_models, const char* cache_directory); // cache_directory may be NULL
+
+#endif
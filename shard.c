@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shard.h"
+#include "squiggle_c/squiggle.h"
+
+#define SHARD_MAGIC 0x46494e4953484152ULL // "FINISHAR"
+#define SHARD_FORMAT_VERSION 1
+
+static uint64_t bit_matrix_apply(const Bit_matrix* matrix, uint64_t x)
+{
+    uint64_t y = 0;
+    for (int j = 0; j < 64; j++) {
+        y ^= matrix->columns[j] & (0 - ((x >> j) & 1));
+    }
+    return y;
+}
+
+void xorshift_jumps_init(Xorshift_jumps* jumps)
+{
+    for (int j = 0; j < 64; j++) {
+        uint64_t basis_vector = (uint64_t)1 << j;
+        jumps->powers[0].columns[j] = xorshift64(&basis_vector);
+    }
+    for (int k = 1; k < 64; k++) {
+        for (int j = 0; j < 64; j++) {
+            jumps->powers[k].columns[j] = bit_matrix_apply(&jumps->powers[k - 1], jumps->powers[k - 1].columns[j]);
+        }
+    }
+}
+
+uint64_t xorshift_jump(const Xorshift_jumps* jumps, uint64_t seed, uint64_t n_steps)
+{
+    // powers[k] is the step matrix to the 2^k. Powers of the same matrix commute, so they can be applied in any order
+    for (int k = 0; k < 64; k++) {
+        if ((n_steps >> k) & 1) seed = bit_matrix_apply(&jumps->powers[k], seed);
+    }
+    return seed;
+}
+
+uint64_t shard_stream_length(uint64_t shard_count, uint64_t n_streams)
+{
+    // The period is 2^64 - 1, i.e., UINT64_MAX
+    return UINT64_MAX / (shard_count + 1) / n_streams;
+}
+
+void shard_stream_seeds(uint64_t shard_index, uint64_t shard_count, uint64_t n_streams, uint64_t first_stream, int n_seeds, uint64_t* seeds)
+{
+    Xorshift_jumps* jumps = (Xorshift_jumps*)malloc(sizeof(Xorshift_jumps));
+    if (jumps == NULL) {
+        fprintf(stderr, "Memory allocation for the RNG jump table failed\n");
+        exit(1);
+    }
+    xorshift_jumps_init(jumps);
+    uint64_t segment_length = UINT64_MAX / (shard_count + 1);
+    uint64_t stream_length = shard_stream_length(shard_count, n_streams);
+    for (int s = 0; s < n_seeds; s++) {
+        seeds[s] = xorshift_jump(jumps, SHARD_BASE_SEED, shard_index * segment_length + (first_stream + (uint64_t)s) * stream_length);
+    }
+    free(jumps);
+}
+
+int shard_file_write(const char* path, Shard_header* header, const unsigned char* payload)
+{
+    // Written next to its final name and renamed over it, so that a task killed halfway never leaves a truncated shard behind
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "wb");
+    if (file == NULL) return 1;
+    uint64_t magic = SHARD_MAGIC;
+    int version = SHARD_FORMAT_VERSION;
+    int ok = fwrite(&magic, sizeof(magic), 1, file) == 1
+        && fwrite(&version, sizeof(version), 1, file) == 1
+        && fwrite(header, sizeof(Shard_header), 1, file) == 1
+        && fwrite(payload, 1, header->payload_size, file) == header->payload_size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) return 1;
+    return rename(tmp_path, path);
+}
+
+unsigned char* shard_file_read(const char* path, Shard_header* header)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    uint64_t magic;
+    int version;
+    unsigned char* payload = NULL;
+    int ok = fread(&magic, sizeof(magic), 1, file) == 1 && magic == SHARD_MAGIC
+        && fread(&version, sizeof(version), 1, file) == 1 && version == SHARD_FORMAT_VERSION
+        && fread(header, sizeof(Shard_header), 1, file) == 1
+        && header->shard_index < header->shard_count
+        && (payload = (unsigned char*)malloc(header->payload_size > 0 ? header->payload_size : 1)) != NULL
+        && fread(payload, 1, header->payload_size, file) == header->payload_size;
+    fclose(file);
+    if (!ok) {
+        free(payload);
+        return NULL;
+    }
+    return payload;
+}
@@ -0,0 +1,68 @@
+#ifndef FINISTERRAE_SHARD
+#define FINISTERRAE_SHARD
+
+#include <stdint.h>
+
+/* Shards: independent runs, e.g., the tasks of a SLURM job array, each writing its stats to a file, merged offline */
+
+/*
+Disjoint RNG substreams, by jumping ahead in xorshift64's sequence.
+xorshift64 with shifts (13, 7, 17) has full period: from any nonzero seed, it goes through all 2^64 - 1 nonzero states
+before coming back. So positions in that cycle, counted from SHARD_BASE_SEED, name distinct states. The cycle is cut into
+shard_count + 1 segments, one per shard and a last one for the pilot run that fixes the shift of the shifted sums (see
+pilot_mean in samples.c; runs without shards are shard 0 of 1), and each segment into n_streams substreams of equal length,
+one per process and purpose. A substream that draws fewer numbers than its length never reaches the next one, so no two
+substreams share a state.
+Processes cut their substreams further, into one slot per chunk of samples, at a fixed stride (see chunk_seed in samples.c),
+and check that their chunks fit. For 1000 shards of 4 processes, 8 substreams of about 2.3 * 10^15 draws, so about
+5 * 10^5 chunks of up to 2^32 draws each; a 1T run draws about 1.5 * 10^4 chunks per process and shard.
+Seeds hashed from draws, for antithetic pairs or common random numbers, start at unrelated points of the cycle, and
+aren't covered by this.
+*/
+#define SHARD_BASE_SEED 0x9e3779b97f4a7c15ULL
+
+// Seeds at the start of substreams first_stream, ..., first_stream + n_seeds - 1 of the shard's segment.
+// shard_index == shard_count is the pilot segment
+void shard_stream_seeds(uint64_t shard_index, uint64_t shard_count, uint64_t n_streams, uint64_t first_stream, int n_seeds, uint64_t* seeds);
+uint64_t shard_stream_length(uint64_t shard_count, uint64_t n_streams); // in draws
+
+/*
+xorshift64 is linear over GF(2): each step multiplies the state, as a vector of 64 bits, by a fixed 64 x 64 bit matrix.
+Jumping ahead by n steps multiplies by that matrix to the n, from its powers of two, by repeated squaring.
+The table of powers takes 32KB, so it is built once and reused for every jump
+*/
+typedef struct _Bit_matrix {
+    uint64_t columns[64]; // column j is the image of bit j
+} Bit_matrix;
+
+typedef struct _Xorshift_jumps {
+    Bit_matrix powers[64]; // the step matrix to the 2^k
+} Xorshift_jumps;
+
+void xorshift_jumps_init(Xorshift_jumps* jumps);
+uint64_t xorshift_jump(const Xorshift_jumps* jumps, uint64_t seed, uint64_t n_steps); // the state n_steps draws after seed
+
+/*
+Shard files: this header, then a payload that the caller lays out, here the stats of samples.c as flat structs.
+Flat structs are only readable by a build with the same struct layout and model, so both are recorded and checked on merge
+*/
+#define SHARD_HASH_LENGTH 32
+
+typedef struct _Shard_header {
+    uint64_t shard_index;
+    uint64_t shard_count;
+    uint64_t n_samples; // drawn by this shard, per variant
+    uint64_t layout; // sizes of the structs in the payload
+    uint64_t payload_size; // in bytes
+    int n_variants;
+    int histogram_n_bins;
+    double histogram_min;
+    double histogram_sup;
+    double histogram_bin_width;
+    char model_code_hash[SHARD_HASH_LENGTH];
+} Shard_header;
+
+int shard_file_write(const char* path, Shard_header* header, const unsigned char* payload); // 0 on success
+unsigned char* shard_file_read(const char* path, Shard_header* header); // the payload, to be freed; NULL if unreadable
+
+#endif
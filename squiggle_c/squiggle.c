@@ -1,16 +1,41 @@
 #include <limits.h>
 #include <math.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#include "squiggle.h"
+#include "squiggle_math.h"
+
 // Defs
-#define PI 3.14159265358979323846 // M_PI in gcc gnu99
 #define NORMAL90CONFIDENCE 1.6448536269514727
 #define UNUSED(x) (void)(x)
 // ^ https://stackoverflow.com/questions/3599160/how-can-i-suppress-unused-parameter-warnings-in-c
+// SQUIGGLE_DISPATCH: see squiggle.h. xorshift64 is small enough that it gets inlined into (and cloned with) each of its callers below
+
+// Instrumentation counters, see squiggle.h
+#ifdef SQUIGGLE_INSTRUMENT
+// Eight counters, so one cache line per thread. The last slot is shared by the threads that don't fit
+static Squiggle_counters counter_slots[SQUIGGLE_MAX_COUNTED_THREADS + 1] __attribute__((aligned(64)));
+static int n_counted_threads = 0;
+_Thread_local Squiggle_counters* squiggle_counters = NULL;
+
+void squiggle_counters_register(void)
+{
+    int index = __atomic_fetch_add(&n_counted_threads, 1, __ATOMIC_RELAXED);
+    squiggle_counters = &counter_slots[index < SQUIGGLE_MAX_COUNTED_THREADS ? index : SQUIGGLE_MAX_COUNTED_THREADS];
+}
+
+int squiggle_counters_get(Squiggle_counters** per_thread)
+{
+    *per_thread = counter_slots;
+    int n = __atomic_load_n(&n_counted_threads, __ATOMIC_ACQUIRE);
+    return n < SQUIGGLE_MAX_COUNTED_THREADS ? n : SQUIGGLE_MAX_COUNTED_THREADS;
+}
+#endif
 
 // Pseudo Random number generators
-static uint64_t xorshift64(uint64_t* seed)
+uint64_t xorshift64(uint64_t* seed)
 {
     // Algorithm "xor" from p. 4 of Marsaglia, "Xorshift RNGs"
     // See:
@@ -19,6 +44,7 @@ static uint64_t xorshift64(uint64_t* seed)
     // Also some drama:
     //   <https://www.pcg-random.org/posts/on-vignas-pcg-critique.html>,
     //   <https://prng.di.unimi.it/>
+    SQUIGGLE_COUNT(xorshift_draws);
     uint64_t x = *seed;
     x ^= x << 13;
     x ^= x >> 7;
@@ -37,20 +63,40 @@ static uint64_t xorshift64(uint64_t* seed)
     */
 }
 
+// Antithetic sampling: while on, this thread's uniforms are reflected, u -> 1 - u.
+// Replaying a seed with it on gives a sample with the same distribution, negatively correlated with the first
+#ifdef SQUIGGLE_ANTITHETIC
+static _Thread_local uint64_t antithetic_mask = 0;
+#define ANTITHETIC_MASK antithetic_mask
+void set_antithetic(int on)
+{
+    antithetic_mask = on ? UINT64_MAX : 0;
+}
+#else
+#define ANTITHETIC_MASK ((uint64_t)0)
+void set_antithetic(int on)
+{
+    UNUSED(on);
+}
+#endif
+
 // Distribution & sampling functions
 // Unit distributions
 double sample_unit_uniform(uint64_t* seed)
 {
     // samples uniform from [0,1] interval.
-    return ((double)xorshift64(seed)) / ((double)UINT64_MAX);
+    return ((double)(xorshift64(seed) ^ ANTITHETIC_MASK)) / ((double)UINT64_MAX);
 }
 
+SQUIGGLE_DISPATCH
 double sample_unit_normal(uint64_t* seed)
 {
     // // See: <https://en.wikipedia.org/wiki/Box%E2%80%93Muller_transform>
-    double u1 = sample_unit_uniform(seed);
+    // u1 isn't reflected in antithetic sampling, so that the antithetic normal is exactly -z
+    SQUIGGLE_COUNT(unit_normals);
+    double u1 = ((double)xorshift64(seed)) / ((double)UINT64_MAX);
     double u2 = sample_unit_uniform(seed);
-    double z = sqrt(-2.0 * log(u1)) * sin(2 * PI * u2);
+    double z = sqrt(-2.0 * squiggle_log(u1)) * squiggle_sin_2pi(u2);
     return z;
 }
 
@@ -65,9 +111,11 @@ double sample_normal(double mean, double sigma, uint64_t* seed)
     return (mean + sigma * sample_unit_normal(seed));
 }
 
+SQUIGGLE_DISPATCH
 double sample_lognormal(double logmean, double logstd, uint64_t* seed)
 {
-    return exp(sample_normal(logmean, logstd, seed));
+    SQUIGGLE_COUNT(lognormal_calls);
+    return squiggle_exp(sample_normal(logmean, logstd, seed));
 }
 
 double sample_normal_from_90_ci(double low, double high, uint64_t* seed)
@@ -95,6 +143,7 @@ double sample_normal_from_90_ci(double low, double high, uint64_t* seed)
     return sample_normal(mean, std, seed);
 }
 
+SQUIGGLE_DISPATCH
 double sample_to(double low, double high, uint64_t* seed)
 {
     // Given a (positive) 90% confidence interval,
@@ -102,11 +151,14 @@ double sample_to(double low, double high, uint64_t* seed)
     // Key idea: If we want a lognormal with 90% confidence interval [a, b]
     // we need but get a normal with 90% confidence interval [log(a), log(b)].
     // Then see code for sample_normal_from_90_ci
-    double loglow = log(low);
-    double loghigh = log(high);
-    return exp(sample_normal_from_90_ci(loglow, loghigh, seed));
+    SQUIGGLE_COUNT(to_calls);
+    SQUIGGLE_COUNT(lognormal_calls);
+    double loglow = squiggle_log(low);
+    double loghigh = squiggle_log(high);
+    return squiggle_exp(sample_normal_from_90_ci(loglow, loghigh, seed));
 }
 
+SQUIGGLE_DISPATCH
 double sample_gamma(double alpha, uint64_t* seed)
 {
 
@@ -119,6 +171,7 @@ double sample_gamma(double alpha, uint64_t* seed)
     // such that gamma_k(alpha, k) = k * gamma(alpha)
     // or gamma_beta(alpha, beta) = gamma(alpha) / beta
     // So far I have not needed to use this, and thus the second parameter is by default 1.
+    SQUIGGLE_COUNT(gamma_calls);
     if (alpha >= 1) {
         double d, c, x, v, u;
         d = alpha - 1.0 / 3.0;
@@ -128,6 +181,7 @@ double sample_gamma(double alpha, uint64_t* seed)
             do {
                 x = sample_unit_normal(seed);
                 v = 1.0 + c * x;
+                if (v <= 0.0) SQUIGGLE_COUNT(gamma_rejections);
             } while (v <= 0.0);
 
             v = v * v * v;
@@ -140,19 +194,23 @@ double sample_gamma(double alpha, uint64_t* seed)
                 // i.e., of not using the logarithms
                 return d * v;
             }
-            if (log(u) < 0.5 * (x * x) + d * (1.0 - v + log(v))) { // Condition 2
+            if (squiggle_log(u) < 0.5 * (x * x) + d * (1.0 - v + squiggle_log(v))) { // Condition 2
                 return d * v;
             }
+            SQUIGGLE_COUNT(gamma_rejections);
         }
     } else {
-        return sample_gamma(1 + alpha, seed) * pow(sample_unit_uniform(seed), 1 / alpha);
+        SQUIGGLE_COUNT(gamma_alpha_below_one);
+        return sample_gamma(1 + alpha, seed) * squiggle_pow_positive(sample_unit_uniform(seed), 1 / alpha);
         // see note in p. 371 of https://dl.acm.org/doi/pdf/10.1145/358407.358414
     }
 }
 
+SQUIGGLE_DISPATCH
 double sample_beta(double a, double b, uint64_t* seed)
 {
     // See: https://en.wikipedia.org/wiki/Gamma_distribution#Related_distributions
+    SQUIGGLE_COUNT(beta_calls);
     double gamma_a = sample_gamma(a, seed);
     double gamma_b = sample_gamma(b, seed);
     return gamma_a / (gamma_a + gamma_b);
@@ -164,40 +222,301 @@ double sample_laplace(double successes, double failures, uint64_t* seed)
     return sample_beta(successes + 1, failures + 1, seed);
 }
 
+// Batch distribution sampling functions
+// These fill an array with n independent samples. The draws are done first, and the
+// arithmetic on them in a separate loop, so that the compiler can vectorize the latter.
+#define BOX_MULLER_BLOCK 256
+SQUIGGLE_DISPATCH
+void sample_unit_normal_batch(double* out, int n, uint64_t* seed)
+{
+    double u1[BOX_MULLER_BLOCK];
+    double u2[BOX_MULLER_BLOCK];
+    for (int start = 0; start < n; start += BOX_MULLER_BLOCK) {
+        int block = (n - start) < BOX_MULLER_BLOCK ? (n - start) : BOX_MULLER_BLOCK;
+        SQUIGGLE_COUNT_N(unit_normals, block);
+        for (int i = 0; i < block; i++) {
+            u1[i] = sample_unit_uniform(seed);
+            u2[i] = sample_unit_uniform(seed);
+        }
+        #pragma omp simd
+        for (int i = 0; i < block; i++) {
+            out[start + i] = sqrt(-2.0 * squiggle_log(u1[i])) * squiggle_sin_2pi(u2[i]);
+        }
+    }
+}
+
+SQUIGGLE_DISPATCH
+void sample_normal_batch(double mean, double sigma, double* out, int n, uint64_t* seed)
+{
+    sample_unit_normal_batch(out, n, seed);
+    #pragma omp simd
+    for (int i = 0; i < n; i++) {
+        out[i] = mean + sigma * out[i];
+    }
+}
+
+SQUIGGLE_DISPATCH
+void sample_lognormal_batch(double logmean, double logstd, double* out, int n, uint64_t* seed)
+{
+    SQUIGGLE_COUNT_N(lognormal_calls, n);
+    sample_normal_batch(logmean, logstd, out, n, seed);
+    #pragma omp simd
+    for (int i = 0; i < n; i++) {
+        out[i] = squiggle_exp(out[i]);
+    }
+}
+
+void sample_to_batch(double low, double high, double* out, int n, uint64_t* seed)
+{
+    // See sample_to; the logs are only taken once per batch
+    SQUIGGLE_COUNT_N(to_calls, n);
+    double loglow = squiggle_log(low);
+    double loghigh = squiggle_log(high);
+    double logmean = (loghigh + loglow) / 2.0;
+    double logstd = (loghigh - loglow) / (2.0 * NORMAL90CONFIDENCE);
+    sample_lognormal_batch(logmean, logstd, out, n, seed);
+}
+
+/*
+Marsaglia-Tsang over SIMD lanes, with lane compaction: each round draws a block of candidates, runs the cheap acceptance
+test (condition 1) on all of them at once, and then writes the accepted ones out in order. The few that fail it take
+the logarithmic test (condition 2) one by one. Rejected lanes are dropped, and the next round refills them.
+*/
+#define GAMMA_BLOCK 256
+SQUIGGLE_DISPATCH
+void sample_gamma_batch(double alpha, double* out, int n, uint64_t* seed)
+{
+    if (alpha < 1) {
+        // As in sample_gamma: gamma(alpha) = gamma(1 + alpha) * u^(1 / alpha)
+        SQUIGGLE_COUNT_N(gamma_alpha_below_one, n);
+        sample_gamma_batch(1 + alpha, out, n, seed);
+        double u[GAMMA_BLOCK];
+        for (int start = 0; start < n; start += GAMMA_BLOCK) {
+            int block = (n - start) < GAMMA_BLOCK ? (n - start) : GAMMA_BLOCK;
+            for (int i = 0; i < block; i++) {
+                u[i] = sample_unit_uniform(seed);
+            }
+            #pragma omp simd
+            for (int i = 0; i < block; i++) {
+                out[start + i] *= squiggle_pow_positive(u[i], 1 / alpha);
+            }
+        }
+        return;
+    }
+    SQUIGGLE_COUNT_N(gamma_calls, n);
+    double d = alpha - 1.0 / 3.0;
+    double c = 1.0 / sqrt(9.0 * d);
+    double x[GAMMA_BLOCK];
+    double u[GAMMA_BLOCK];
+    double v[GAMMA_BLOCK];
+    int squeezed[GAMMA_BLOCK];
+    int filled = 0;
+    while (filled < n) {
+        // Candidates for the missing samples, and a few more, since about 2% get rejected for the parameters in our models
+        int missing = n - filled;
+        int block = missing + missing / 16 + 4;
+        if (block > GAMMA_BLOCK) block = GAMMA_BLOCK;
+        sample_unit_normal_batch(x, block, seed);
+        for (int i = 0; i < block; i++) {
+            u[i] = sample_unit_uniform(seed);
+        }
+        #pragma omp simd
+        for (int i = 0; i < block; i++) {
+            double t = 1.0 + c * x[i];
+            double x2 = x[i] * x[i];
+            v[i] = t * t * t;
+            squeezed[i] = (t > 0.0) & (u[i] < 1.0 - 0.0331 * (x2 * x2)); // condition 1
+        }
+        for (int i = 0; i < block && filled < n; i++) {
+            int accepted = squeezed[i] || (v[i] > 0.0 && squiggle_log(u[i]) < 0.5 * (x[i] * x[i]) + d * (1.0 - v[i] + squiggle_log(v[i]))); // condition 2
+            out[filled] = d * v[i]; // overwritten by the next candidate if rejected
+            filled += accepted;
+            SQUIGGLE_COUNT_N(gamma_rejections, !accepted);
+        }
+    }
+}
+
+SQUIGGLE_DISPATCH
+void sample_beta_batch(double a, double b, double* out, int n, uint64_t* seed)
+{
+    // Two gamma batches, then X / (X + Y) lane by lane
+    SQUIGGLE_COUNT_N(beta_calls, n);
+    double gamma_b[GAMMA_BLOCK];
+    for (int start = 0; start < n; start += GAMMA_BLOCK) {
+        int block = (n - start) < GAMMA_BLOCK ? (n - start) : GAMMA_BLOCK;
+        sample_gamma_batch(a, out + start, block, seed);
+        sample_gamma_batch(b, gamma_b, block, seed);
+        #pragma omp simd
+        for (int i = 0; i < block; i++) {
+            out[start + i] = out[start + i] / (out[start + i] + gamma_b[i]);
+        }
+    }
+}
+
 // Array helpers
-double array_sum(double* array, int length)
+/*
+Sums go over fixed blocks of ARRAY_BLOCK elements, each into ARRAY_LANES running partial sums that the compiler maps onto
+vector registers, and the block results are then combined in block order. As neither the blocks nor the lanes depend on
+the thread count or the instruction set, neither do the results, as long as the compiler doesn't fuse a multiply and an add
+into an FMA where the target has one: build with -ffp-contract=off, as the makefile does. Arrays of ARRAY_PARALLEL_MIN_BLOCKS
+blocks or more are split over OpenMP threads; smaller ones, like mixture weights, stay on the calling thread.
+*/
+#define ARRAY_BLOCK 4096
+#define ARRAY_LANES 8
+#define ARRAY_PARALLEL_MIN_BLOCKS 16
+
+static void* array_malloc(size_t size)
+{
+    // The helpers return their results, not a status, so running out of memory is fatal, as in partition
+    void* result = malloc(size > 0 ? size : 1);
+    if (result == NULL) {
+        fprintf(stderr, "Memory allocation of %zu bytes in squiggle.c's array helpers failed.\n", size);
+        exit(1);
+    }
+    return result;
+}
+
+static double array_block_sum(double* array, int64_t length)
+{
+    double lanes[ARRAY_LANES] = { 0.0 };
+    int64_t n_full = length - length % ARRAY_LANES;
+    for (int64_t i = 0; i < n_full; i += ARRAY_LANES) {
+        #pragma omp simd
+        for (int j = 0; j < ARRAY_LANES; j++) {
+            lanes[j] += array[i + j];
+        }
+    }
+    for (int64_t i = n_full; i < length; i++) {
+        lanes[i - n_full] += array[i];
+    }
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+static double array_block_squared_deviations(double* array, int64_t length, double mean)
+{
+    double lanes[ARRAY_LANES] = { 0.0 };
+    int64_t n_full = length - length % ARRAY_LANES;
+    for (int64_t i = 0; i < n_full; i += ARRAY_LANES) {
+        #pragma omp simd
+        for (int j = 0; j < ARRAY_LANES; j++) {
+            double deviation = array[i + j] - mean;
+            lanes[j] += deviation * deviation;
+        }
+    }
+    for (int64_t i = n_full; i < length; i++) {
+        double deviation = array[i] - mean;
+        lanes[i - n_full] += deviation * deviation;
+    }
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+static int64_t array_n_blocks(int64_t length)
+{
+    return (length + ARRAY_BLOCK - 1) / ARRAY_BLOCK;
+}
+
+static int64_t array_block_length(int64_t length, int64_t block)
+{
+    int64_t remaining = length - block * ARRAY_BLOCK;
+    return remaining < ARRAY_BLOCK ? remaining : ARRAY_BLOCK;
+}
+
+SQUIGGLE_DISPATCH
+double array_sum(double* array, int64_t length)
 {
-    double sum = 0.0;
-    // #pragma omp parallel for reduction(+:sum)
-    for (int i = 0; i < length; i++) {
-        sum += array[i];
+    int64_t n_blocks = array_n_blocks(length);
+    if (n_blocks <= 1) return length > 0 ? array_block_sum(array, length) : 0.0;
+    double* block_sums = (double*)array_malloc((size_t)n_blocks * sizeof(double));
+    #pragma omp parallel for schedule(static) if (n_blocks >= ARRAY_PARALLEL_MIN_BLOCKS)
+    for (int64_t block = 0; block < n_blocks; block++) {
+        block_sums[block] = array_block_sum(array + block * ARRAY_BLOCK, array_block_length(length, block));
     }
+    double sum = array_block_sum(block_sums, n_blocks);
+    free(block_sums);
     return sum;
 }
 
-void array_cumsum(double* array_to_sum, double* array_cumsummed, int length)
+SQUIGGLE_DISPATCH
+void array_cumsum(double* array_to_sum, double* array_cumsummed, int64_t length)
 {
-    array_cumsummed[0] = array_to_sum[0];
-    for (int i = 1; i < length; i++) {
-        array_cumsummed[i] = array_cumsummed[i - 1] + array_to_sum[i];
+    // Block sums, their exclusive scan, and then a running sum within each block, from its offset
+    int64_t n_blocks = array_n_blocks(length);
+    if (n_blocks < ARRAY_PARALLEL_MIN_BLOCKS) {
+        double running_sum = 0.0;
+        for (int64_t i = 0; i < length; i++) {
+            running_sum += array_to_sum[i];
+            array_cumsummed[i] = running_sum;
+        }
+        return;
+    }
+    double* offsets = (double*)array_malloc((size_t)n_blocks * sizeof(double));
+    #pragma omp parallel for schedule(static)
+    for (int64_t block = 0; block < n_blocks; block++) {
+        offsets[block] = array_block_sum(array_to_sum + block * ARRAY_BLOCK, array_block_length(length, block));
+    }
+    double offset = 0.0;
+    for (int64_t block = 0; block < n_blocks; block++) {
+        double block_sum = offsets[block];
+        offsets[block] = offset;
+        offset += block_sum;
+    }
+    #pragma omp parallel for schedule(static)
+    for (int64_t block = 0; block < n_blocks; block++) {
+        double running_sum = offsets[block];
+        int64_t end = block * ARRAY_BLOCK + array_block_length(length, block);
+        for (int64_t i = block * ARRAY_BLOCK; i < end; i++) {
+            running_sum += array_to_sum[i];
+            array_cumsummed[i] = running_sum;
+        }
     }
+    free(offsets);
 }
 
-double array_mean(double* array, int length)
+double array_mean(double* array, int64_t length)
 {
     double sum = array_sum(array, length);
-    return sum / length;
+    return sum / (double)length;
 }
 
-double array_std(double* array, int length)
+SQUIGGLE_DISPATCH
+void array_mean_std(double* array, int64_t length, double* mean, double* std)
 {
-    double mean = array_mean(array, length);
-    double std = 0.0;
-    // #pragma omp parallel for reduction(+:std)
-    for (int i = 0; i < length; i++) {
-        std += (array[i] - mean) * (array[i] - mean);
+    // One pass over memory: each block, while in cache, gets its mean and then its sum of squared deviations from it.
+    // Blocks are then merged in order with Chan et al.'s update, which doesn't cancel catastrophically as sum(x^2) - n mean^2 would
+    int64_t n_blocks = array_n_blocks(length);
+    if (n_blocks == 0) {
+        *mean = NAN;
+        *std = NAN;
+        return;
     }
-    std = sqrt(std / length);
+    double* block_means = (double*)array_malloc((size_t)n_blocks * sizeof(double));
+    double* block_m2s = (double*)array_malloc((size_t)n_blocks * sizeof(double));
+    #pragma omp parallel for schedule(static) if (n_blocks >= ARRAY_PARALLEL_MIN_BLOCKS)
+    for (int64_t block = 0; block < n_blocks; block++) {
+        double* xs = array + block * ARRAY_BLOCK;
+        int64_t n = array_block_length(length, block);
+        block_means[block] = array_block_sum(xs, n) / (double)n;
+        block_m2s[block] = array_block_squared_deviations(xs, n, block_means[block]);
+    }
+    double n_total = 0.0, mean_total = 0.0, m2_total = 0.0;
+    for (int64_t block = 0; block < n_blocks; block++) {
+        double n = (double)array_block_length(length, block);
+        double delta = block_means[block] - mean_total;
+        double n_merged = n_total + n;
+        mean_total += delta * (n / n_merged);
+        m2_total += block_m2s[block] + delta * delta * (n_total * n / n_merged);
+        n_total = n_merged;
+    }
+    free(block_means);
+    free(block_m2s);
+    *mean = mean_total;
+    *std = sqrt(m2_total / (double)length);
+}
+
+double array_std(double* array, int64_t length)
+{
+    double mean, std;
+    array_mean_std(array, length, &mean, &std);
     return std;
 }
 
@@ -206,7 +525,7 @@ double sample_mixture(double (*samplers[])(uint64_t*), double* weights, int n_di
 {
     // Sample from samples with frequency proportional to their weights.
     double sum_weights = array_sum(weights, n_dists);
-    double* cumsummed_normalized_weights = (double*)malloc((size_t)n_dists * sizeof(double));
+    double* cumsummed_normalized_weights = (double*)array_malloc((size_t)n_dists * sizeof(double));
     cumsummed_normalized_weights[0] = weights[0] / sum_weights;
     for (int i = 1; i < n_dists; i++) {
         cumsummed_normalized_weights[i] = cumsummed_normalized_weights[i - 1] + weights[i] / sum_weights;
@@ -4,8 +4,65 @@
 // uint64_t header
 #include <stdint.h>
 
+// Function multiversioning for the hot samplers
+// With -DSQUIGGLE_MULTIVERSION, gcc/clang emit one clone per instruction set
+// and the loader picks the best one for the node we land on (via ifunc).
+// icc and non-x86 targets just get the default version.
+#if defined(SQUIGGLE_MULTIVERSION) && defined(__GNUC__) && !defined(__INTEL_COMPILER) && defined(__x86_64__)
+#define SQUIGGLE_DISPATCH __attribute__((target_clones("default", "sse4.2", "avx2", "avx512f")))
+#else
+#define SQUIGGLE_DISPATCH
+#endif
+
+// Instrumentation: with -DSQUIGGLE_INSTRUMENT, each thread counts what the samplers below do, per sampler rather than per call site.
+// Without it, SQUIGGLE_COUNT expands to nothing, so release builds pay nothing for it.
+#ifdef SQUIGGLE_INSTRUMENT
+typedef struct _Squiggle_counters {
+    uint64_t xorshift_draws;
+    uint64_t unit_normals;
+    uint64_t lognormal_calls; // including through sample_to
+    uint64_t to_calls;
+    uint64_t beta_calls;
+    uint64_t gamma_calls; // including recursive calls
+    uint64_t gamma_alpha_below_one; // calls that recurse with alpha + 1
+    uint64_t gamma_rejections; // Marsaglia-Tsang proposals rejected, including those with v <= 0
+} Squiggle_counters;
+#define SQUIGGLE_MAX_COUNTED_THREADS 1024
+// Each thread's counters are a slot of a static array, not thread-local storage, so they can still be read after the thread has exited.
+// Threads past SQUIGGLE_MAX_COUNTED_THREADS count into a slot that is never read
+extern _Thread_local Squiggle_counters* squiggle_counters;
+void squiggle_counters_register(void);
+int squiggle_counters_get(Squiggle_counters** per_thread); // the counters of every thread that has counted anything; returns how many
+#define SQUIGGLE_COUNT_N(counter, n)                                    \
+    do {                                                                \
+        if (squiggle_counters == NULL) squiggle_counters_register();    \
+        squiggle_counters->counter += (n);                              \
+    } while (0)
+#else
+#define SQUIGGLE_COUNT_N(counter, n) \
+    do {                             \
+    } while (0)
+#endif
+#define SQUIGGLE_COUNT(counter) SQUIGGLE_COUNT_N(counter, 1)
+
 // Pseudo Random number generator
 uint64_t xorshift64(uint64_t* seed);
+// splitmix64's finalizer, so that a seed drawn from a stream, or made from an index, starts somewhere unrelated to it
+// <https://prng.di.unimi.it/splitmix64.c>
+static inline uint64_t mix_seed(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+// Antithetic sampling, only with -DSQUIGGLE_ANTITHETIC (make build-antithetic): per thread, while on, uniforms are reflected, u -> 1 - u.
+// Other builds never reflect, so that their draws don't pay for it
+#ifdef SQUIGGLE_ANTITHETIC
+#define SQUIGGLE_HAS_ANTITHETIC 1
+#else
+#define SQUIGGLE_HAS_ANTITHETIC 0
+#endif
+void set_antithetic(int on);
 
 // Basic distribution sampling functions
 double sample_unit_uniform(uint64_t* seed);
@@ -22,11 +79,21 @@ double sample_gamma(double alpha, uint64_t* seed);
 double sample_beta(double a, double b, uint64_t* seed);
 double sample_laplace(double successes, double failures, uint64_t* seed);
 
-// Array helpers
-double array_sum(double* array, int length);
-void array_cumsum(double* array_to_sum, double* array_cumsummed, int length);
-double array_mean(double* array, int length);
-double array_std(double* array, int length);
+// Batch distribution sampling functions: fill out[0..n) with independent samples
+#define SAMPLER_BATCH_SIZE 4096 // samples per batch in columnar models; 32KB per input
+void sample_unit_normal_batch(double* out, int n, uint64_t* seed);
+void sample_normal_batch(double mean, double sigma, double* out, int n, uint64_t* seed);
+void sample_lognormal_batch(double logmean, double logstd, double* out, int n, uint64_t* seed);
+void sample_to_batch(double low, double high, double* out, int n, uint64_t* seed);
+void sample_gamma_batch(double alpha, double* out, int n, uint64_t* seed); // vectorized Marsaglia-Tsang, with lane compaction
+void sample_beta_batch(double a, double b, double* out, int n, uint64_t* seed);
+
+// Array helpers: parallel over OpenMP threads for large arrays, and with the same results whatever the thread count (see squiggle.c)
+double array_sum(double* array, int64_t length);
+void array_cumsum(double* array_to_sum, double* array_cumsummed, int64_t length);
+double array_mean(double* array, int64_t length);
+double array_std(double* array, int64_t length); // population std, as before
+void array_mean_std(double* array, int64_t length, double* mean, double* std); // both in one pass over memory
 
 // Mixture function
 double sample_mixture(double (*samplers[])(uint64_t*), double* weights, int n_dists, uint64_t* seed);
@@ -0,0 +1,157 @@
+#ifndef SQUIGGLE_MATH
+#define SQUIGGLE_MATH
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+Transcendental functions for the samplers: exp, log, sin and cos of 2 pi u, and pow for positive bases.
+They are branch-free inline functions, so that they inline into the samplers and vectorize in their batch loops,
+and they give the same results whatever the compiler or its libm.
+Error bounds, measured against long double references over the samplers' input ranges (benchmarks/math.c):
+- squiggle_exp: < 1 ulp. Below -708.39, where results would be subnormal, it flushes to 0; above 709.78, it's +inf
+- squiggle_log: < 1 ulp. log(0) = -inf; negative inputs give NaN
+- squiggle_sin_2pi, squiggle_cos_2pi: < 1 ulp of 1, i.e., absolute error below 1.2e-16
+- squiggle_pow_positive: < (1 + |y log x|) ulp, as it is exp(y log x) without extra precision.
+  That is fine for pow(u, 1 / alpha) in sample_gamma, but it isn't a general pow
+Reductions follow Cody and Waite. The log, sin and cos polynomials are fdlibm's <https://www.netlib.org/fdlibm/>;
+exp sums its Taylor series instead. Integers are read off the low bits of x + SQUIGGLE_ROUNDING_SHIFT, without conversions.
+Build with -DSQUIGGLE_LIBM to use libm instead, e.g., to compare against it.
+*/
+
+static inline uint64_t squiggle_double_bits(double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+static inline double squiggle_bits_double(uint64_t bits)
+{
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+#ifdef SQUIGGLE_LIBM
+static inline double squiggle_exp(double x) { return exp(x); }
+static inline double squiggle_log(double x) { return log(x); }
+static inline double squiggle_sin_2pi(double u) { return sin(2 * M_PI * u); }
+static inline double squiggle_cos_2pi(double u) { return cos(2 * M_PI * u); }
+static inline double squiggle_pow_positive(double x, double y) { return pow(x, y); }
+#else
+
+#define SQUIGGLE_LN2_HI 6.93147180369123816490e-01 // upper bits of ln 2, so that k * SQUIGGLE_LN2_HI is exact
+#define SQUIGGLE_LN2_LO 1.90821492927058770002e-10
+#define SQUIGGLE_ROUNDING_SHIFT 0x1.8p52 // adding and subtracting it rounds to the nearest integer
+
+static inline double squiggle_exp(double x)
+{
+    // exp(x) = 2^k * exp(r), with x = k ln 2 + r and |r| <= ln 2 / 2; exp(r) from its Taylor series to r^13, whose remainder is below 2^-57
+    double clamped = x < -708.39 ? -708.39 : (x > 709.79 ? 709.79 : x);
+    double shifted = clamped * 1.44269504088896338700e+00 + SQUIGGLE_ROUNDING_SHIFT;
+    double k = shifted - SQUIGGLE_ROUNDING_SHIFT;
+    double r = (clamped - k * SQUIGGLE_LN2_HI) - k * SQUIGGLE_LN2_LO;
+    double p = 1.0 / 6227020800.0;
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    double exp_r = 1.0 + (r + r * r * p);
+    // 2^k from exponent bits, in two halves, as k goes up to 1024 at the top of the range.
+    // The integers are read off the low bits of k + SQUIGGLE_ROUNDING_SHIFT, as there is no vector conversion from double to int64 before AVX-512
+    double k_half = (0.5 * k + SQUIGGLE_ROUNDING_SHIFT) - SQUIGGLE_ROUNDING_SHIFT;
+    uint64_t k_half_int = squiggle_double_bits(k_half + SQUIGGLE_ROUNDING_SHIFT) - squiggle_double_bits(SQUIGGLE_ROUNDING_SHIFT);
+    uint64_t k_rest_int = squiggle_double_bits((k - k_half) + SQUIGGLE_ROUNDING_SHIFT) - squiggle_double_bits(SQUIGGLE_ROUNDING_SHIFT);
+    double scale_1 = squiggle_bits_double((k_half_int + 1023) << 52);
+    double scale_2 = squiggle_bits_double((k_rest_int + 1023) << 52);
+    double result = exp_r * scale_1 * scale_2;
+    result = x > 709.782712893383973096 ? INFINITY : result;
+    result = x < -708.39 ? 0.0 : result;
+    return x != x ? x : result;
+}
+
+static inline double squiggle_log(double x)
+{
+    // x = 2^e * m, with m in [sqrt(2) / 2, sqrt(2)); log(m) = log(1 + f) = f - f^2 / 2 + s * (f^2 / 2 + R(s^2)), with s = f / (2 + f)
+    int is_subnormal = x < 2.2250738585072014e-308;
+    double scaled = is_subnormal ? x * 0x1p54 : x;
+    uint64_t bits = squiggle_double_bits(scaled);
+    // The exponent field, as a double, by the same trick run backwards
+    double exponent = squiggle_bits_double(squiggle_double_bits(SQUIGGLE_ROUNDING_SHIFT) + ((bits >> 52) & 0x7ff)) - SQUIGGLE_ROUNDING_SHIFT;
+    double m = squiggle_bits_double((bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL);
+    int above_sqrt2 = m > 1.41421356237309504880;
+    m = above_sqrt2 ? 0.5 * m : m;
+    double k = exponent - 1023.0 - (is_subnormal ? 54.0 : 0.0) + (above_sqrt2 ? 1.0 : 0.0);
+    double f = m - 1.0;
+    double s = f / (2.0 + f);
+    double z = s * s;
+    double R = z * (6.666666666666735130e-01 + z * (3.999999999940941908e-01 + z * (2.857142874366239149e-01 + z * (2.222219843214978396e-01 + z * (1.818357216161805012e-01 + z * (1.531383769920937332e-01 + z * 1.479819860511658591e-01))))));
+    double hfsq = 0.5 * f * f;
+    double result = k * SQUIGGLE_LN2_HI - ((hfsq - (s * (hfsq + R) + k * SQUIGGLE_LN2_LO)) - f);
+    result = x == INFINITY ? x : result;
+    result = x == 0.0 ? -INFINITY : result;
+    return (x < 0.0 || x != x) ? NAN : result;
+}
+
+/* sin and cos on [-pi/4, pi/4] */
+static inline double squiggle_kernel_sin(double x)
+{
+    double z = x * x;
+    double r = -1.66666666666666324348e-01 + z * (8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04 + z * (2.75573137070700676789e-06 + z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10))));
+    return x + x * z * r;
+}
+
+static inline double squiggle_kernel_cos(double x)
+{
+    double z = x * x;
+    double r = z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 + z * (2.48015872894767294178e-05 + z * (-2.75573143513906633035e-07 + z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11)))));
+    double hz = 0.5 * z;
+    double w = 1.0 - hz;
+    return w + (((1.0 - w) - hz) + z * r);
+}
+
+static inline void squiggle_sincos_2pi(double u, double* sin_2pi_u, double* cos_2pi_u)
+{
+    // In turns rather than radians, the reduction is exact: u - round(u) in [-1/2, 1/2], then a quadrant q and t in [-1/8, 1/8]
+    double r = u - ((u + SQUIGGLE_ROUNDING_SHIFT) - SQUIGGLE_ROUNDING_SHIFT);
+    double shifted_q = 4.0 * r + SQUIGGLE_ROUNDING_SHIFT;
+    double q = shifted_q - SQUIGGLE_ROUNDING_SHIFT;
+    double t = r - 0.25 * q;
+    double x = t * 6.28318530717958647693;
+    double s = squiggle_kernel_sin(x);
+    double c = squiggle_kernel_cos(x);
+    uint64_t quadrant = (squiggle_double_bits(shifted_q) - squiggle_double_bits(SQUIGGLE_ROUNDING_SHIFT)) & 3; // q mod 4, as in squiggle_exp
+    *sin_2pi_u = quadrant == 0 ? s : (quadrant == 1 ? c : (quadrant == 2 ? -s : -c));
+    *cos_2pi_u = quadrant == 0 ? c : (quadrant == 1 ? -s : (quadrant == 2 ? -c : s));
+}
+
+static inline double squiggle_sin_2pi(double u)
+{
+    double s, c;
+    squiggle_sincos_2pi(u, &s, &c);
+    return s;
+}
+
+static inline double squiggle_cos_2pi(double u)
+{
+    double s, c;
+    squiggle_sincos_2pi(u, &s, &c);
+    return c;
+}
+
+static inline double squiggle_pow_positive(double x, double y)
+{
+    return squiggle_exp(y * squiggle_log(x));
+}
+#endif
+
+#endif
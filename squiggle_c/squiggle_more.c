@@ -1,4 +1,5 @@
 #include "squiggle.h"
+#include "squiggle_more.h"
 #include <float.h>
 #include <limits.h>
 #include <math.h>
@@ -8,57 +9,82 @@
 #include <stdlib.h>
 #include <string.h> // memcpy
 
-// Quantities
-#define THOUSAND 1000
-#define MILLION (1000 * 1000)
-#define BILLION (1000 * MILLION)
-#define TRILLION ((uint64_t)1000 * (uint64_t)BILLION)
-
-/* Cache optimizations */
-#define CACHE_LINE_SIZE 64
-// getconf LEVEL1_DCACHE_LINESIZE
-// <https://stackoverflow.com/questions/794632/programmatically-get-the-cache-line-size>
-typedef struct seed_cache_box_t {
-    uint64_t seed;
-    char padding[CACHE_LINE_SIZE - sizeof(uint64_t)];
-    // Cache line size is 64 *bytes*, uint64_t is 64 *bits* (8 bytes). Different units!
-} seed_cache_box;
-// This avoids "false sharing", i.e., different threads competing for the same cache line
-// Dealing with this shaves 4ms from a 12ms process, or a third of runtime
-// <http://www.nic.uoregon.edu/~khuck/ts/acumem-report/manual_html/ch06s07.html>
-
 /* Parallel sampler */
-void sampler_parallel(double (*sampler)(uint64_t* seed), double* results, int n_threads, uint64_t n_samples, int m_seed)
-{
-    seed_cache_box* cache_box = (seed_cache_box*)malloc(sizeof(seed_cache_box) * (size_t)n_threads);
+typedef struct sampler_ctx_t {
+    int n_threads;
+    seed_cache_box* cache_box; // one seed per thread, each on its own cache line
+} sampler_ctx;
 
-    srand(m_seed);
-    for (int thread_id = 0; thread_id < n_threads; thread_id++) {
-        // Nuño to Jorge: you can't do this in parallel, since rand() is not thread safe
-        cache_box[thread_id].seed = (uint64_t)rand() * (UINT64_MAX / RAND_MAX);
+sampler_ctx* sampler_ctx_create(int n_threads, uint64_t seed)
+{
+    sampler_ctx* ctx = (sampler_ctx*)malloc(sizeof(sampler_ctx));
+    if (ctx == NULL) return NULL;
+    ctx->n_threads = n_threads > 0 ? n_threads : omp_get_max_threads();
+    ctx->cache_box = (seed_cache_box*)aligned_alloc(CACHE_LINE_SIZE, sizeof(seed_cache_box) * (size_t)ctx->n_threads);
+    if (ctx->cache_box == NULL) {
+        free(ctx);
+        return NULL;
+    }
+    for (int thread_id = 0; thread_id < ctx->n_threads; thread_id++) {
+        ctx->cache_box[thread_id].seed = mix_seed(seed + (uint64_t)thread_id * 0x9e3779b97f4a7c15ULL) | 1; // xorshift64 needs a nonzero seed
     }
+    return ctx;
+}
 
-    omp_set_dynamic(0); 
-    omp_set_num_threads(n_threads);
+void sampler_ctx_free(sampler_ctx* ctx)
+{
+    free(ctx->cache_box);
+    free(ctx);
+}
+
+int sampler_ctx_n_threads(sampler_ctx* ctx)
+{
+    return ctx->n_threads;
+}
 
-    int i;
-    #pragma omp parallel private(i)
+void sampler_parallel_ctx(sampler_ctx* ctx, double (*sampler)(uint64_t* seed), double* results, uint64_t n_samples)
+{
+    // Static schedule: thread t always draws the same slice of results, so a given ctx, seed and sequence of calls gives the same samples
+    seed_cache_box* cache_box = ctx->cache_box;
+    #pragma omp parallel num_threads(ctx->n_threads)
     {
-        int thread_id = omp_get_thread_num();
-        #pragma omp for
-        for (i = 0; i < n_samples; i++) {
-            results[i] = sampler(&(cache_box[thread_id].seed));
+        uint64_t* seed = &(cache_box[omp_get_thread_num()].seed);
+        #pragma omp for schedule(static)
+        for (uint64_t i = 0; i < n_samples; i++) {
+            results[i] = sampler(seed);
         }
     }
-    free(cache_box);
 }
 
-/* Get confidence intervals, given a sampler */
+void sampler_parallel_batch_ctx(sampler_ctx* ctx, void (*batch_sampler)(double* out, int n, uint64_t* seed), double* results, uint64_t n_samples)
+{
+    seed_cache_box* cache_box = ctx->cache_box;
+    uint64_t n_batches = (n_samples + SAMPLER_BATCH_SIZE - 1) / SAMPLER_BATCH_SIZE;
+    #pragma omp parallel num_threads(ctx->n_threads)
+    {
+        uint64_t* seed = &(cache_box[omp_get_thread_num()].seed);
+        #pragma omp for schedule(static)
+        for (uint64_t batch = 0; batch < n_batches; batch++) {
+            uint64_t start = batch * SAMPLER_BATCH_SIZE;
+            uint64_t n = n_samples - start < SAMPLER_BATCH_SIZE ? n_samples - start : SAMPLER_BATCH_SIZE;
+            batch_sampler(results + start, (int)n, seed);
+        }
+    }
+}
 
-typedef struct ci_t {
-    double low;
-    double high;
-} ci;
+void sampler_parallel(double (*sampler)(uint64_t* seed), double* results, int n_threads, uint64_t n_samples, int m_seed)
+{
+    // One-off: for many calls, create a sampler_ctx once and reuse it
+    sampler_ctx* ctx = sampler_ctx_create(n_threads, (uint64_t)m_seed);
+    if (ctx == NULL) {
+        printf("Memory allocation failed in sampler_parallel in %s (%d)\n", __FILE__, __LINE__);
+        exit(1);
+    }
+    sampler_parallel_ctx(ctx, sampler, results, n_samples);
+    sampler_ctx_free(ctx);
+}
+
+/* Get confidence intervals, given a sampler */
 
 inline static void swp(int i, int j, double xs[])
 {
@@ -93,6 +119,10 @@ static double quickselect(int k, double xs[], int n)
     // https://en.wikipedia.org/wiki/Quickselect
 
     double* ys = malloc((size_t)n * sizeof(double));
+    if (ys == NULL) {
+        printf("Memory allocation failed in quickselect in %s (%d)\n", __FILE__, __LINE__);
+        exit(1);
+    }
     memcpy(ys, xs, (size_t)n * sizeof(double));
     // ^: don't rearrange item order in the original array
 
@@ -143,8 +173,8 @@ void array_print_stats(double xs[], int n){
     ci ci_80 = array_get_ci((ci) { .low = 0.1, .high = 0.9 }, xs, n);
     ci ci_50 = array_get_ci((ci) { .low = 0.25, .high = 0.75 }, xs, n);
     double median = array_get_median(xs, n);
-    double mean = array_mean(xs, n);
-    double std = array_std(xs, n);
+    double mean, std;
+    array_mean_std(xs, n, &mean, &std);
     printf("Mean: %lf\n"
            " Std: %lf\n"
            "  5%%: %lf\n"
@@ -157,6 +187,34 @@ void array_print_stats(double xs[], int n){
            mean, std, ci_90.low, ci_80.low, ci_50.low, median, ci_50.high, ci_80.high, ci_90.high);
 }
 
+void print_histogram_bin(double bin_start, double bin_width, uint64_t count, uint64_t total_count, double scale){
+    double bin_end = bin_start + bin_width;
+    if(bin_width < 0.01){
+        printf("  [%4.3f, %4.3f): ", bin_start, bin_end); 
+    } else if(bin_width < 0.1){
+        printf("  [%4.2f, %4.2f): ", bin_start, bin_end); 
+    } else if(bin_width < 1){
+        printf("  [%4.1f, %4.1f): ", bin_start, bin_end); 
+    } else if(bin_width < 10){
+        printf("  [%4.0f, %4.0f): ", bin_start, bin_end); 
+    } else {
+        printf("  [%4f, %4f): ", bin_start, bin_end); 
+    }
+    // number of decimals could depend on the number of bins
+    // or on the size of the smallest bucket
+
+    uint64_t marks = (uint64_t)(count * scale);
+    for (uint64_t j = 0; j < marks; j++) {
+        printf("█");
+    }
+    printf(" %ld", count);
+    double pct = 100.0 * (double)count/(double)total_count;
+    if(pct > (0.1/100.0)){
+        printf(" (%.3f%%)", pct);
+    }
+    printf("\n");
+}
+
 void print_histogram(uint64_t* bins, int n_bins, double min_value, double bin_width){
 
     // Calculate the scaling factor based on the maximum bin count
@@ -168,45 +226,19 @@ void print_histogram(uint64_t* bins, int n_bins, double min_value, double bin_wi
         }
         total_bin_count+=bins[i];
     }
-    const int MAX_WIDTH = 50; // Adjust this to your terminal width
-    double scale = max_bin_count > MAX_WIDTH ? (double)MAX_WIDTH / max_bin_count : 1.0;
+    double scale = max_bin_count > HISTOGRAM_MAX_WIDTH ? (double)HISTOGRAM_MAX_WIDTH / max_bin_count : 1.0;
 
     // Print the histogram
     for (int i = 0; i < n_bins; i++) {
         if (bins[i] == 0){
             continue;
         }
-        double bin_start = min_value + i * bin_width;
-        double bin_end = bin_start + bin_width;
-        if(bin_width < 0.01){
-            printf("  [%4.3f, %4.3f): ", bin_start, bin_end); 
-        } else if(bin_width < 0.1){
-            printf("  [%4.2f, %4.2f): ", bin_start, bin_end); 
-        } else if(bin_width < 1){
-            printf("  [%4.1f, %4.1f): ", bin_start, bin_end); 
-        } else if(bin_width < 10){
-            printf("  [%4.0f, %4.0f): ", bin_start, bin_end); 
-        } else {
-            printf("  [%4f, %4f): ", bin_start, bin_end); 
-        }
-        // number of decimals could depend on the number of bins
-        // or on the size of the smallest bucket
-
-        uint64_t marks = (uint64_t)(bins[i] * scale);
-        for (int j = 0; j < marks; j++) {
-            printf("█");
-        }
-        printf(" %ld", bins[i]);
-        double pct = 100.0 * (double)bins[i]/(double)total_bin_count;
-        if(pct > (0.1/100.0)){
-            printf(" (%.3f%%)", pct);
-        }
-        printf("\n");
+        print_histogram_bin(min_value + i * bin_width, bin_width, bins[i], total_bin_count, scale);
     }
 
 }
 
-void array_print_histogram(double* xs, int n_samples, int n_bins) {
+void array_print_histogram(double* xs, int64_t n_samples, int n_bins) {
     // Generated with the help of an llm; there might be subtle off-by-one errors
     // interface inspired by <https://github.com/red-data-tools/YouPlot>
     if (n_bins <= 0) {
@@ -226,13 +258,10 @@ void array_print_histogram(double* xs, int n_samples, int n_bins) {
     double min_value = xs[0], max_value = xs[0];
 
     // Find the minimum and maximum values from the samples
-    for (int i = 0; i < n_samples; i++) {
-        if (xs[i] < min_value) {
-            min_value = xs[i];
-        }
-        if (xs[i] > max_value) {
-            max_value = xs[i];
-        }
+    #pragma omp parallel for simd reduction(min : min_value) reduction(max : max_value) if (n_samples >= MILLION)
+    for (int64_t i = 0; i < n_samples; i++) {
+        min_value = xs[i] < min_value ? xs[i] : min_value;
+        max_value = xs[i] > max_value ? xs[i] : max_value;
     }
 
     // Avoid division by zero for a single unique value
@@ -244,8 +273,9 @@ void array_print_histogram(double* xs, int n_samples, int n_bins) {
     double range = max_value - min_value;
     double bin_width = range / n_bins;
 
-    // Fill the bins with sample counts
-    for (int i = 0; i < n_samples; i++) {
+    // Fill the bins with sample counts; counts are integers, so the array reduction is exact whatever the thread count
+    #pragma omp parallel for reduction(+ : bins[:n_bins]) if (n_samples >= MILLION)
+    for (int64_t i = 0; i < n_samples; i++) {
         int bin_index = (int)((xs[i] - min_value) / bin_width);
         if (bin_index == n_bins) {
             bin_index--; // Last bin includes max_value
@@ -265,6 +295,10 @@ ci sampler_get_ci(ci interval, double (*sampler)(uint64_t*), int n, uint64_t* se
 {
     UNUSED(seed); // don't want to use it right now, but want to preserve ability to do so (e.g., remove parallelism from internals). Also nicer for consistency.
     double* xs = malloc((size_t)n * sizeof(double));
+    if (xs == NULL) {
+        printf("Memory allocation failed in sampler_get_ci in %s (%d)\n", __FILE__, __LINE__);
+        exit(1);
+    }
     sampler_parallel(sampler, xs, 16, n, 1);
     ci result = array_get_ci(interval, xs, n);
     free(xs);
@@ -279,11 +313,6 @@ ci sampler_get_90_ci(double (*sampler)(uint64_t*), int n, uint64_t* seed)
 
 #define NORMAL90CONFIDENCE 1.6448536269514727
 
-typedef struct normal_params_t {
-    double mean;
-    double std;
-} normal_params;
-
 normal_params algebra_sum_normals(normal_params a, normal_params b)
 {
     normal_params result = {
@@ -293,11 +322,6 @@ normal_params algebra_sum_normals(normal_params a, normal_params b)
     return result;
 }
 
-typedef struct lognormal_params_t {
-    double logmean;
-    double logstd;
-} lognormal_params;
-
 lognormal_params algebra_product_lognormals(lognormal_params a, lognormal_params b)
 {
     lognormal_params result = {
@@ -331,16 +355,6 @@ ci convert_lognormal_params_to_ci(lognormal_params y)
 // and that operation might fail
 // so we build some scaffolding here
 
-#define MAX_ERROR_LENGTH 500
-#define EXIT_ON_ERROR 0
-#define PROCESS_ERROR(error_msg) process_error(error_msg, EXIT_ON_ERROR, __FILE__, __LINE__)
-
-typedef struct box_t {
-    int empty;
-    double content;
-    char* error_msg;
-} box;
-
 box process_error(const char* error_msg, int should_exit, char* file, int line)
 {
     if (should_exit) {
@@ -6,8 +6,29 @@
 #define BILLION (1000 * MILLION)
 #define TRILLION ((uint64_t)1000 * (uint64_t)BILLION)
 
+/* Cache optimizations */
+#define CACHE_LINE_SIZE 64
+// getconf LEVEL1_DCACHE_LINESIZE
+// <https://stackoverflow.com/questions/794632/programmatically-get-the-cache-line-size>
+typedef struct seed_cache_box_t {
+    uint64_t seed;
+    char padding[CACHE_LINE_SIZE - sizeof(uint64_t)];
+    // Cache line size is 64 *bytes*, uint64_t is 64 *bits* (8 bytes). Different units!
+} seed_cache_box;
+// This avoids "false sharing", i.e., different threads competing for the same cache line
+// Dealing with this shaves 4ms from a 12ms process, or a third of runtime
+// <http://www.nic.uoregon.edu/~khuck/ts/acumem-report/manual_html/ch06s07.html>
+
 /* Parallel sampling */
-void sampler_parallel(double (*sampler)(uint64_t* seed), double* results, int n_threads, uint64_t n_samples, int m_seed);
+// A sampler_ctx keeps its threads' RNG states across calls, so that callers drawing many batches, e.g., in parameter sweeps,
+// only pay for its setup once. It doesn't touch OpenMP's global settings. Calls on the same ctx mustn't overlap
+typedef struct sampler_ctx_t sampler_ctx;
+sampler_ctx* sampler_ctx_create(int n_threads, uint64_t seed); // n_threads <= 0: omp_get_max_threads(). NULL if out of memory
+void sampler_ctx_free(sampler_ctx* ctx);
+int sampler_ctx_n_threads(sampler_ctx* ctx);
+void sampler_parallel_ctx(sampler_ctx* ctx, double (*sampler)(uint64_t* seed), double* results, uint64_t n_samples);
+void sampler_parallel_batch_ctx(sampler_ctx* ctx, void (*batch_sampler)(double* out, int n, uint64_t* seed), double* results, uint64_t n_samples); // in SAMPLER_BATCH_SIZE batches
+void sampler_parallel(double (*sampler)(uint64_t* seed), double* results, int n_threads, uint64_t n_samples, int m_seed); // one-off ctx
 
 /* Get median and confidence intervals */
 double array_get_median(double xs[], int n);
@@ -18,8 +39,10 @@ typedef struct ci_t {
 ci array_get_ci(ci interval, double* xs, int n);
 ci array_get_90_ci(double xs[], int n);
 void array_print_stats(double xs[], int n);
-void array_print_histogram(double* xs, int n_samples, int n_bins);
+void array_print_histogram(double* xs, int64_t n_samples, int n_bins);
 void print_histogram(uint64_t* bins, int n_bins, double min_value, double bin_width); // underlying primitive
+#define HISTOGRAM_MAX_WIDTH 50 // in marks; adjust this to your terminal width
+void print_histogram_bin(double bin_start, double bin_width, uint64_t count, uint64_t total_count, double scale); // one line of print_histogram, with marks = count * scale
 
 // Deprecated: get confidence intervals directly from samplers
 ci sampler_get_ci(ci interval, double (*sampler)(uint64_t*), int n, uint64_t* seed);
@@ -0,0 +1,223 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tail.h"
+
+/*
+Generalized Pareto tail, see e.g., Coles, 2001, "An Introduction to Statistical Modeling of Extreme Values", ch. 4
+Above a high threshold u, P(X > u + y | X > u) = (1 + xi * y / sigma)^(-1/xi).
+We fit xi and sigma by maximum likelihood to the samples above the smallest one we have kept,
+and extrapolate quantiles far beyond what we have sampled from it.
+*/
+
+Tail_stats tail_stats_init(void)
+{
+    Tail_stats tail;
+    tail.n_samples = 0;
+    tail.n = 0;
+    return tail;
+}
+
+/* Min-heap of the largest values */
+static void heap_swap(double* values, int i, int j)
+{
+    double tmp = values[i];
+    values[i] = values[j];
+    values[j] = tmp;
+}
+
+static void heap_push(Tail_stats* tail, double x)
+{
+    if (tail->n < TAIL_CAPACITY) {
+        int i = tail->n++;
+        tail->values[i] = x;
+        while (i > 0 && tail->values[(i - 1) / 2] > tail->values[i]) {
+            heap_swap(tail->values, i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    } else if (x > tail->values[0]) {
+        // Replace the current threshold, and sift down
+        tail->values[0] = x;
+        int i = 0;
+        for (;;) {
+            int smallest = i;
+            int left = 2 * i + 1;
+            int right = 2 * i + 2;
+            if (left < tail->n && tail->values[left] < tail->values[smallest]) smallest = left;
+            if (right < tail->n && tail->values[right] < tail->values[smallest]) smallest = right;
+            if (smallest == i) break;
+            heap_swap(tail->values, i, smallest);
+            i = smallest;
+        }
+    }
+}
+
+void tail_add(Tail_stats* tail, double x)
+{
+    tail->n_samples++;
+    heap_push(tail, x);
+}
+
+void tail_merge(Tail_stats* accumulator, Tail_stats* new)
+{
+    accumulator->n_samples += new->n_samples;
+    for (int i = 0; i < new->n; i++) {
+        heap_push(accumulator, new->values[i]);
+    }
+}
+
+/* Fit */
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double gpd_profile_loglikelihood(double theta, double* ys, int n, double* shape, double* scale)
+{
+    // Reparametrize with theta = xi / sigma. For a given theta, the likelihood is maximized at
+    // xi = mean(log(1 + theta * y)), and the log likelihood is -n * log(sigma) - n * (1 + xi)
+    // See Grimshaw, 1993, "Computing maximum likelihood estimates for the generalized Pareto distribution"
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        sum += log1p(theta * ys[i]);
+    }
+    *shape = sum / n;
+    *scale = *shape / theta;
+    if (!(*scale > 0)) return -INFINITY;
+    return -n * log(*scale) - n * (1 + *shape);
+}
+
+#define GPD_GRID_SIZE 200 // a multiple of 4
+
+Gpd_fit tail_fit(Tail_stats* tail)
+{
+    Gpd_fit fit;
+    memset(&fit, 0, sizeof(Gpd_fit));
+    if (tail->n < 3) return fit;
+
+    // Exceedances over the threshold, i.e., over the smallest value kept
+    double threshold = tail->values[0];
+    int n = 0;
+    double* ys = (double*)malloc((size_t)tail->n * sizeof(double));
+    double y_max = 0.0;
+    double y_sum = 0.0;
+    for (int i = 0; i < tail->n; i++) {
+        if (tail->values[i] > threshold) {
+            ys[n] = tail->values[i] - threshold;
+            if (ys[n] > y_max) y_max = ys[n];
+            n++;
+        }
+    }
+    // The heap's order depends on the order of adds and merges, but the set of values kept doesn't. Sorted, sums over them don't either
+    qsort(ys, (size_t)n, sizeof(double), compare_doubles);
+    for (int i = 0; i < n; i++) {
+        y_sum += ys[i];
+    }
+    fit.n_exceedances = n;
+    fit.threshold = threshold;
+    fit.exceedance_probability = (double)n / (double)tail->n_samples;
+    fit.var_exceedance_probability = fit.exceedance_probability * (1 - fit.exceedance_probability) / (double)tail->n_samples;
+    if (n < 3) {
+        free(ys);
+        return fit;
+    }
+
+    // theta ranges over (-1/y_max, infinity). Search t = theta * y_max on a coarse grid, then refine by golden section
+    // between the grid points either side of the best one. The grid is log-spaced towards each end of (-1, -0.5], [-0.5, 0) and (0, 10^6)
+    double ts[GPD_GRID_SIZE];
+    for (int g = 0; g < GPD_GRID_SIZE / 4; g++) {
+        ts[g] = -1.0 + pow(10, -8.0 + (8.0 - log10(2.0)) * g / (GPD_GRID_SIZE / 4 - 1)); // -1 + 10^-8, ..., -0.5
+        ts[GPD_GRID_SIZE / 4 + g] = -pow(10, -log10(2.0) - (8.0 - log10(2.0)) * (g + 1) / (GPD_GRID_SIZE / 4)); // ..., -10^-8
+    }
+    for (int g = 0; g < GPD_GRID_SIZE / 2; g++) {
+        ts[GPD_GRID_SIZE / 2 + g] = pow(10, -8.0 + 14.0 * g / (GPD_GRID_SIZE / 2 - 1)); // 10^-8, ..., 10^6
+    }
+    int best = 0;
+    double best_loglikelihood = -INFINITY;
+    double shape, scale;
+    for (int g = 0; g < GPD_GRID_SIZE; g++) {
+        double loglikelihood = gpd_profile_loglikelihood(ts[g] / y_max, ys, n, &shape, &scale);
+        if (loglikelihood > best_loglikelihood) {
+            best_loglikelihood = loglikelihood;
+            best = g;
+        }
+    }
+    double low = best > 0 ? ts[best - 1] : -1.0;
+    double high = best < GPD_GRID_SIZE - 1 ? ts[best + 1] : ts[best] * 10;
+    const double GOLDEN = 0.6180339887498949;
+    for (int iter = 0; iter < 100; iter++) {
+        double t1 = high - GOLDEN * (high - low);
+        double t2 = low + GOLDEN * (high - low);
+        if (gpd_profile_loglikelihood(t1 / y_max, ys, n, &shape, &scale) > gpd_profile_loglikelihood(t2 / y_max, ys, n, &shape, &scale)) {
+            high = t2;
+        } else {
+            low = t1;
+        }
+    }
+    double loglikelihood = gpd_profile_loglikelihood((low + high) / 2 / y_max, ys, n, &shape, &scale);
+    double exponential_loglikelihood = -n * log(y_sum / n) - n; // the xi -> 0 limit
+    if (!(loglikelihood > exponential_loglikelihood)) {
+        shape = 0.0;
+        scale = y_sum / n;
+    }
+    fit.shape = shape;
+    fit.scale = scale;
+
+    // Asymptotic covariance of the maximum likelihood estimates, valid for xi > -0.5.
+    // In this (xi, sigma) parametrization the covariance is negative; it is positive for k = -xi, as in Hosking and Wallis
+    fit.var_shape = (1 + shape) * (1 + shape) / n;
+    fit.var_scale = 2 * scale * scale * (1 + shape) / n;
+    fit.cov_shape_scale = -scale * (1 + shape) / n;
+
+    free(ys);
+    return fit;
+}
+
+double gpd_quantile(Gpd_fit fit, double p, double* std_error)
+{
+    // x_p = u + sigma / xi * ((zeta / p)^xi - 1), where zeta = P(X > u)
+    // with the standard error from the delta method on (zeta, xi, sigma), zeta being asymptotically independent of the other two
+    // (Coles, "An introduction to statistical modeling of extreme values", 4.3.3)
+    double log_ratio = log(fit.exceedance_probability / p);
+    double quantile, d_shape, d_scale, d_exceedance_probability;
+    if (fabs(fit.shape) < 1e-12) {
+        quantile = fit.threshold + fit.scale * log_ratio;
+        d_scale = log_ratio;
+        d_shape = fit.scale * log_ratio * log_ratio / 2;
+        d_exceedance_probability = fit.scale / fit.exceedance_probability;
+    } else {
+        double power = exp(fit.shape * log_ratio);
+        quantile = fit.threshold + fit.scale / fit.shape * (power - 1);
+        d_scale = (power - 1) / fit.shape;
+        d_shape = -fit.scale / (fit.shape * fit.shape) * (power - 1) + fit.scale / fit.shape * power * log_ratio;
+        d_exceedance_probability = fit.scale / fit.exceedance_probability * power;
+    }
+    if (std_error != NULL) {
+        double variance = d_shape * d_shape * fit.var_shape + d_scale * d_scale * fit.var_scale + 2 * d_shape * d_scale * fit.cov_shape_scale
+            + d_exceedance_probability * d_exceedance_probability * fit.var_exceedance_probability;
+        *std_error = sqrt(variance);
+    }
+    return quantile;
+}
+
+void print_tail(Tail_stats* tail)
+{
+    Gpd_fit fit = tail_fit(tail);
+    if (fit.n_exceedances < 3) return;
+
+    printf("Tail (generalized Pareto fit to %d exceedances over %lf, P(X > threshold) = %.3e) {\n", fit.n_exceedances, fit.threshold, fit.exceedance_probability);
+    printf("  Shape (xi):    %12.6lf, 95%% c.i. [%lf, %lf]\n", fit.shape, fit.shape - 1.96 * sqrt(fit.var_shape), fit.shape + 1.96 * sqrt(fit.var_shape));
+    printf("  Scale (sigma): %12.6lf, 95%% c.i. [%lf, %lf]\n", fit.scale, fit.scale - 1.96 * sqrt(fit.var_scale), fit.scale + 1.96 * sqrt(fit.var_scale));
+    for (int exponent = 3; exponent <= 15; exponent++) {
+        double p = pow(10, -exponent);
+        if (p >= fit.exceedance_probability) continue;
+        double std_error;
+        double quantile = gpd_quantile(fit, p, &std_error);
+        printf("  1 in 10^%-2d:   %12.6lf, 95%% c.i. [%lf, %lf]%s\n", exponent, quantile, quantile - 1.96 * std_error, quantile + 1.96 * std_error, p * tail->n_samples < 1 ? " (extrapolated)" : "");
+    }
+    printf("}\n");
+}
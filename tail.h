@@ -0,0 +1,37 @@
+#ifndef FINISTERRAE_TAIL
+#define FINISTERRAE_TAIL
+
+#include <stdint.h>
+
+/* Peaks over threshold: keep the largest samples, and fit a generalized Pareto distribution to them */
+
+// Fixed size, so that stats can be gathered over MPI as a flat struct.
+// The threshold is adaptive: it is the smallest of the TAIL_CAPACITY largest samples seen so far
+#define TAIL_CAPACITY 4096
+
+typedef struct _Tail_stats {
+    uint64_t n_samples; // all samples seen, not just the ones kept
+    int n;
+    double values[TAIL_CAPACITY]; // min-heap, so that values[0] is the threshold
+} Tail_stats;
+
+typedef struct _Gpd_fit {
+    int n_exceedances;
+    double threshold;
+    double exceedance_probability; // of the threshold
+    double var_exceedance_probability; // binomial, k / n out of n samples
+    double shape; // xi
+    double scale; // sigma
+    double var_shape;
+    double var_scale;
+    double cov_shape_scale;
+} Gpd_fit;
+
+Tail_stats tail_stats_init(void);
+void tail_add(Tail_stats* tail, double x);
+void tail_merge(Tail_stats* accumulator, Tail_stats* new);
+Gpd_fit tail_fit(Tail_stats* tail);
+double gpd_quantile(Gpd_fit fit, double p, double* std_error); // value exceeded with probability p
+void print_tail(Tail_stats* tail);
+
+#endif
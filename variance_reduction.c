@@ -0,0 +1,179 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "variance_reduction.h"
+
+/*
+Antithetic pairs: each unit is the average of a sample and its reflection (u -> 1 - u in every uniform draw).
+The pairs are independent of each other, so the standard error comes from the variance of the pair averages.
+
+Control variates: with inputs c whose means mu are known, the mean of y - beta * (c - mu) is also
+an estimator of E[y], and with beta = Cov(c, c)^-1 Cov(c, y) its variance is the residual variance of
+regressing y on c. See e.g., Owen, "Monte Carlo theory, methods and examples", ch. 8 and 9
+<https://artowen.su.domains/mc/>
+All of these only need sums, so they can be accumulated per chunk and merged across ranks.
+*/
+
+Variance_reduction_stats variance_reduction_stats_init(const Sensitivity_model* model, int unit_size, double shift)
+{
+    Variance_reduction_stats stats;
+    memset(&stats, 0, sizeof(Variance_reduction_stats));
+    stats.model = model;
+    stats.unit_size = unit_size;
+    stats.shift = shift;
+    return stats;
+}
+
+static double known_mean(const Sensitivity_model* model, int i)
+{
+    // Inputs without a known mean aren't used as controls, and are summed unshifted
+    return isnan(model->input_means[i]) ? 0.0 : model->input_means[i];
+}
+
+void variance_reduction_add(Variance_reduction_stats* stats, double* ys, double inputs[][MAX_SENSITIVITY_INPUTS])
+{
+    double y = 0.0;
+    for (int k = 0; k < stats->unit_size; k++) {
+        y += ys[k];
+    }
+    y = y / stats->unit_size - stats->shift;
+    stats->n_units++;
+    stats->sum_y += y;
+    stats->sum_y_squared += y * y;
+
+    if (stats->model == NULL || stats->model->input_means == NULL) return;
+    int n_inputs = stats->model->n_inputs;
+    double c[MAX_SENSITIVITY_INPUTS];
+    for (int i = 0; i < n_inputs; i++) {
+        c[i] = 0.0;
+        for (int k = 0; k < stats->unit_size; k++) {
+            c[i] += inputs[k][i];
+        }
+        c[i] = c[i] / stats->unit_size - known_mean(stats->model, i);
+    }
+    for (int i = 0; i < n_inputs; i++) {
+        stats->sum_c[i] += c[i];
+        stats->sum_cy[i] += c[i] * y;
+        for (int j = 0; j <= i; j++) {
+            stats->sum_cc[i][j] += c[i] * c[j];
+        }
+    }
+}
+
+void variance_reduction_merge(Variance_reduction_stats* accumulator, Variance_reduction_stats* new)
+{
+    if (new->n_units == 0) return;
+    if (accumulator->n_units == 0) accumulator->shift = new->shift;
+    accumulator->n_units += new->n_units;
+    accumulator->sum_y += new->sum_y;
+    accumulator->sum_y_squared += new->sum_y_squared;
+    for (int i = 0; i < MAX_SENSITIVITY_INPUTS; i++) {
+        accumulator->sum_c[i] += new->sum_c[i];
+        accumulator->sum_cy[i] += new->sum_cy[i];
+        for (int j = 0; j <= i; j++) {
+            accumulator->sum_cc[i][j] += new->sum_cc[i][j];
+        }
+    }
+}
+
+static int solve_linear_system(double a[][MAX_SENSITIVITY_INPUTS], double* b, double* x, int n)
+{
+    // Gaussian elimination with partial pivoting; a and b are overwritten
+    for (int col = 0; col < n; col++) {
+        int pivot = col;
+        for (int row = col + 1; row < n; row++) {
+            if (fabs(a[row][col]) > fabs(a[pivot][col])) pivot = row;
+        }
+        if (fabs(a[pivot][col]) < 1e-300) return 1;
+        for (int k = 0; k < n; k++) {
+            double tmp = a[col][k];
+            a[col][k] = a[pivot][k];
+            a[pivot][k] = tmp;
+        }
+        double tmp = b[col];
+        b[col] = b[pivot];
+        b[pivot] = tmp;
+        for (int row = col + 1; row < n; row++) {
+            double factor = a[row][col] / a[col][col];
+            for (int k = col; k < n; k++) {
+                a[row][k] -= factor * a[col][k];
+            }
+            b[row] -= factor * b[col];
+        }
+    }
+    for (int row = n - 1; row >= 0; row--) {
+        double sum = b[row];
+        for (int k = row + 1; k < n; k++) {
+            sum -= a[row][k] * x[k];
+        }
+        x[row] = sum / a[row][row];
+    }
+    return 0;
+}
+
+static void print_estimate(const char* name, double mean, double variance_of_units, uint64_t n_units, double naive_variance_of_mean)
+{
+    double variance_of_mean = variance_of_units / (double)n_units;
+    printf("  %-18s %15.10lf, std. error %.3e", name, mean, sqrt(variance_of_mean));
+    if (naive_variance_of_mean > 0) {
+        printf(", variance reduction %.2fx", naive_variance_of_mean / variance_of_mean);
+    }
+    printf("\n");
+}
+
+void print_variance_reduction(Variance_reduction_stats* stats, uint64_t n_samples, double mean, double variance)
+{
+    if (stats->n_units < 2) return;
+    double naive_variance_of_mean = variance / (double)n_samples;
+    printf("Mean estimates {\n");
+    print_estimate("Naive:", mean, variance, n_samples, 0);
+
+    // Means below are of the shifted values, so they are small, and nothing much cancels when they are subtracted
+    double n = (double)stats->n_units;
+    double mean_y = stats->sum_y / n;
+    double variance_y = stats->sum_y_squared / n - mean_y * mean_y;
+    if (stats->unit_size == 2) {
+        print_estimate("Antithetic pairs:", stats->shift + mean_y, variance_y, stats->n_units, naive_variance_of_mean);
+    }
+
+    const Sensitivity_model* model = stats->model;
+    if (model != NULL && model->input_means != NULL) {
+        // Controls: inputs with a known mean that actually vary
+        int controls[MAX_SENSITIVITY_INPUTS];
+        int n_controls = 0;
+        for (int i = 0; i < model->n_inputs; i++) {
+            double mean_c = stats->sum_c[i] / n;
+            double variance_c = stats->sum_cc[i][i] / n - mean_c * mean_c;
+            if (!isnan(model->input_means[i]) && variance_c > 1e-12 * model->input_means[i] * model->input_means[i]) {
+                controls[n_controls++] = i;
+            }
+        }
+        // beta = Cov(c, c)^-1 Cov(c, y)
+        double covariance_cc[MAX_SENSITIVITY_INPUTS][MAX_SENSITIVITY_INPUTS];
+        double covariance_cy[MAX_SENSITIVITY_INPUTS];
+        double covariance_cy_copy[MAX_SENSITIVITY_INPUTS];
+        double beta[MAX_SENSITIVITY_INPUTS];
+        for (int a = 0; a < n_controls; a++) {
+            int i = controls[a];
+            for (int b = 0; b < n_controls; b++) {
+                int j = controls[b];
+                double sum_cc = i >= j ? stats->sum_cc[i][j] : stats->sum_cc[j][i];
+                covariance_cc[a][b] = sum_cc / n - (stats->sum_c[i] / n) * (stats->sum_c[j] / n);
+            }
+            covariance_cy[a] = stats->sum_cy[i] / n - (stats->sum_c[i] / n) * mean_y;
+            covariance_cy_copy[a] = covariance_cy[a];
+        }
+        if (n_controls > 0 && solve_linear_system(covariance_cc, covariance_cy_copy, beta, n_controls) == 0) {
+            double mean_cv = mean_y;
+            double residual_variance = variance_y;
+            for (int a = 0; a < n_controls; a++) {
+                int i = controls[a];
+                mean_cv -= beta[a] * (stats->sum_c[i] / n); // the mean of c - mu
+                residual_variance -= beta[a] * covariance_cy[a];
+            }
+            print_estimate(stats->unit_size == 2 ? "Antithetic + c.v.:" : "Control variates:", stats->shift + mean_cv, residual_variance, stats->n_units, naive_variance_of_mean);
+        }
+    }
+    printf("}\n");
+}
@@ -0,0 +1,34 @@
+#ifndef FINISTERRAE_VARIANCE_REDUCTION
+#define FINISTERRAE_VARIANCE_REDUCTION
+
+#include <stdint.h>
+
+#include "sensitivity.h"
+
+/* Estimators of the mean with lower variance than the sample mean: antithetic pairs and control variates */
+
+typedef struct _Variance_reduction_stats {
+    const Sensitivity_model* model; // local to each process, not merged. NULL if no control variates
+    // Units are antithetic pairs, averaged, or single samples without antithetic sampling
+    uint64_t n_units;
+    int unit_size;
+    // Sums of shifted values, so that variances and covariances don't come from subtracting large, nearly equal sums:
+    // y - shift, with the same shift for every process and iteration, and c - mu, with the known means mu of the inputs.
+    // Plain doubles, unlike the exact sums of the moments: at over 150 sums, exact ones would take some 100KB per struct.
+    // Merged chunk by chunk in a fixed order, then rank by rank, they don't depend on the threads; they do round differently
+    // with node aggregation, which merges ranks node by node first
+    double shift;
+    double sum_y;
+    double sum_y_squared;
+    // Control variates: the model's inputs with known means
+    double sum_c[MAX_SENSITIVITY_INPUTS];
+    double sum_cy[MAX_SENSITIVITY_INPUTS];
+    double sum_cc[MAX_SENSITIVITY_INPUTS][MAX_SENSITIVITY_INPUTS];
+} Variance_reduction_stats;
+
+Variance_reduction_stats variance_reduction_stats_init(const Sensitivity_model* model, int unit_size, double shift);
+void variance_reduction_add(Variance_reduction_stats* stats, double* ys, double inputs[][MAX_SENSITIVITY_INPUTS]);
+void variance_reduction_merge(Variance_reduction_stats* accumulator, Variance_reduction_stats* new);
+void print_variance_reduction(Variance_reduction_stats* stats, uint64_t n_samples, double mean, double variance);
+
+#endif
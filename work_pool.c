@@ -0,0 +1,162 @@
+#include <stdlib.h>
+
+#include "work_pool.h"
+
+typedef struct _Worker_arg {
+    Work_pool* pool;
+    int worker_id;
+} Worker_arg;
+
+static int take_chunk(Work_pool* pool, int worker_id, int64_t* chunk)
+{
+    Work_range* own = &pool->ranges[worker_id];
+    pthread_mutex_lock(&own->lock);
+    int found = own->begin < own->end;
+    if (found) *chunk = own->begin++;
+    pthread_mutex_unlock(&own->lock);
+    if (found) return 1;
+
+    // Steal the back half of the first range that isn't empty, starting with the next worker
+    for (int k = 1; k < pool->n_workers; k++) {
+        Work_range* victim = &pool->ranges[(worker_id + k) % pool->n_workers];
+        pthread_mutex_lock(&victim->lock);
+        int64_t remaining = victim->end - victim->begin;
+        int64_t stolen_begin = victim->end - (remaining + 1) / 2;
+        int64_t stolen_end = victim->end;
+        if (remaining > 0) victim->end = stolen_begin;
+        pthread_mutex_unlock(&victim->lock);
+        if (remaining > 0) {
+            pthread_mutex_lock(&own->lock);
+            own->begin = stolen_begin + 1;
+            own->end = stolen_end;
+            pthread_mutex_unlock(&own->lock);
+            *chunk = stolen_begin;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void work(Work_pool* pool, int worker_id)
+{
+    int64_t chunk;
+    while (take_chunk(pool, worker_id, &chunk)) {
+        int64_t begin = chunk * pool->chunk_size;
+        int64_t end = begin + pool->chunk_size < pool->n_items ? begin + pool->chunk_size : pool->n_items;
+        pool->task(begin, end, chunk, pool->context);
+    }
+}
+
+static void* worker_loop(void* arg)
+{
+    Work_pool* pool = ((Worker_arg*)arg)->pool;
+    int worker_id = ((Worker_arg*)arg)->worker_id;
+    free(arg);
+    uint64_t seen_generation = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->generation == seen_generation && !pool->stopping) {
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+        if (pool->stopping) {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        work(pool, worker_id);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->n_running == 0) pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+static void free_pool(Work_pool* pool, int n_started)
+{
+    // Stops and joins workers 1, ..., n_started - 1
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int w = 1; w < n_started; w++) {
+        pthread_join(pool->threads[w], NULL);
+    }
+    for (int w = 0; w < pool->n_workers; w++) {
+        pthread_mutex_destroy(&pool->ranges[w].lock);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->ranges);
+    free(pool->threads);
+    free(pool);
+}
+
+Work_pool* work_pool_create(int n_workers)
+{
+    Work_pool* pool = (Work_pool*)calloc(1, sizeof(Work_pool));
+    if (pool == NULL) return NULL;
+    pool->n_workers = n_workers > 0 ? n_workers : 1;
+    pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * (size_t)pool->n_workers);
+    pool->ranges = (Work_range*)calloc((size_t)pool->n_workers, sizeof(Work_range));
+    if (pool->threads == NULL || pool->ranges == NULL) {
+        free(pool->threads);
+        free(pool->ranges);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (int w = 0; w < pool->n_workers; w++) {
+        pthread_mutex_init(&pool->ranges[w].lock, NULL);
+    }
+    for (int w = 1; w < pool->n_workers; w++) {
+        Worker_arg* arg = (Worker_arg*)malloc(sizeof(Worker_arg));
+        if (arg == NULL) {
+            free_pool(pool, w);
+            return NULL;
+        }
+        arg->pool = pool;
+        arg->worker_id = w;
+        if (pthread_create(&pool->threads[w], NULL, worker_loop, arg) != 0) {
+            free(arg);
+            free_pool(pool, w);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void work_pool_run(Work_pool* pool, int64_t n_items, int64_t chunk_size, Work_task task, void* context)
+{
+    int64_t n_chunks = (n_items + chunk_size - 1) / chunk_size;
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->context = context;
+    pool->n_items = n_items;
+    pool->chunk_size = chunk_size;
+    for (int w = 0; w < pool->n_workers; w++) {
+        pool->ranges[w].begin = n_chunks * w / pool->n_workers;
+        pool->ranges[w].end = n_chunks * (w + 1) / pool->n_workers;
+    }
+    pool->n_running = pool->n_workers - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    work(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->n_running > 0) {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void work_pool_destroy(Work_pool* pool)
+{
+    free_pool(pool, pool->n_workers);
+}
@@ -0,0 +1,46 @@
+#ifndef FINISTERRAE_WORK_POOL
+#define FINISTERRAE_WORK_POOL
+
+#include <pthread.h>
+#include <stdint.h>
+
+/* Work stealing: persistent workers that run fixed-size chunks of a loop, and steal chunks from each other when they run out */
+
+/*
+Each worker starts with an even share of the chunks, as a contiguous range, and takes chunks from its front.
+A worker whose range is empty steals the back half of another worker's range.
+The workers stay alive between runs, waiting on a condition variable, so a run costs no thread creation.
+The thread calling work_pool_run is worker 0.
+samples.c only runs its sampling phase here; the statistics phases after it are still omp parallel regions.
+*/
+typedef struct _Work_range {
+    pthread_mutex_t lock;
+    int64_t begin; // chunk indices
+    int64_t end;
+    char padding[64];
+} Work_range;
+
+typedef void (*Work_task)(int64_t begin, int64_t end, int64_t chunk, void* context);
+
+typedef struct _Work_pool {
+    int n_workers;
+    pthread_t* threads;
+    Work_range* ranges;
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t generation; // incremented for each run
+    int n_running;
+    int stopping;
+    // The current run
+    Work_task task;
+    void* context;
+    int64_t n_items;
+    int64_t chunk_size;
+} Work_pool;
+
+Work_pool* work_pool_create(int n_workers); // NULL if out of memory, or if a worker thread can't be started
+void work_pool_run(Work_pool* pool, int64_t n_items, int64_t chunk_size, Work_task task, void* context); // task gets items [begin, end), which are chunk number chunk
+void work_pool_destroy(Work_pool* pool);
+
+#endif